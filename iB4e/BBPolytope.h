@@ -15,7 +15,15 @@
 #include <CGAL/Origin.h>
 #include <CGAL/Gmpq.h>
 
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <list>
+#include <numeric>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace iB4e
 {
@@ -36,8 +44,8 @@ namespace iB4e
         ConvexHull(dim, R())
         {};
 
-        void build(); // Implementation below for readability
-        virtual FPoint vertex_oracle (FVector objective) = 0;
+        void build(bool rounds = false); // Implementation below for readability
+        virtual FPoint vertex_oracle (FVector objective) = 0; // Must be safe to call concurrently if build uses rounds
 
     protected:
         // Typedef magic, part 2
@@ -46,6 +54,7 @@ namespace iB4e
         typedef typename LinearAlgebra::Matrix LMatrix;
         typedef typename LinearAlgebra::Vector LVector;
         typedef typename ConvexHull::Facet_iterator Facet_iterator;
+        typedef typename ConvexHull::Facet_handle Facet_handle;
         typedef typename FVector::Base_vector Base_vector;
 
 
@@ -53,13 +62,21 @@ namespace iB4e
         virtual void hook_preinit() {};
         virtual void hook_postinit() {};
         virtual void hook_perloop(size_t confirmed) {};
-        virtual void hook_unconfirmed(Facet_iterator facet) {};
-        virtual void hook_confirmed(Facet_iterator facet) {};
+        virtual void hook_unconfirmed(Facet_handle facet) {};
+        virtual void hook_confirmed(Facet_handle facet) {};
         virtual void hook_postloop() {};
+
+        long oracle_calls = 0; // Number of calls to vertex_oracle made by the main loop of build
+
+        static const void* facet_key(Facet_handle f) { return &*f; } // Identify a facet independently of its handle type
+        bool queue_unconfirmed_facets(std::deque<Facet_handle>& unconfirmed);
+        bool test_round(std::deque<Facet_handle>& unconfirmed, std::set<const void*>& retired, int& confirmed);
+        void insert_point(const FPoint& point, std::deque<Facet_handle>& unconfirmed, std::set<const void*>& retired);
+        void report_failed_test(Facet_handle facet, const Hyperplane& hp, const FVector& innernormal, const FPoint& result);
     };
 
     template <typename F>
-        void BBPolytope<F>::build() {
+        void BBPolytope<F>::build(bool rounds) {
         // For now, only allow this to run if the polytope is empty
         //assert(this->current_dimension() == 0);
         int dim = this->dimension();
@@ -139,45 +156,56 @@ namespace iB4e
         hook_postinit();
 
         // MAIN LOOP
-        bool all_confirmed_so_far = false;
+        /*
+          Unconfirmed facets wait in a queue, which insert_point updates with the facets each insertion creates.
+          Facets which leave the hull are only recorded as retired and skipped when they come up.
+          When the queue runs dry, one scan of the hull refills it with any unconfirmed facet it missed.
+        */
+        std::deque<Facet_handle> unconfirmed;
+        std::set<const void*> retired;
         int confirmed = 0;
-        while (not all_confirmed_so_far) {
+
+        while (queue_unconfirmed_facets(unconfirmed)) {
+            retired.clear();
             hook_perloop(confirmed);
 
-            all_confirmed_so_far = true;
-
-            // Attempt to confirm every facet
-            for (Facet_iterator f = this->facets_begin(); f != this->facets_end() and all_confirmed_so_far ; f++) {
-                if (not f->is_confirmed()) { // If the facet is not already confirmed, test it
-                    Hyperplane hp = this->hyperplane_supporting(f);
-                    FVector innernormal = -hp.orthogonal_vector(); // CGAL returns the outer normal
-                    FPoint result = vertex_oracle(innernormal);
-
-                    switch (hp.oriented_side(result)) {
-                    case CGAL::ON_POSITIVE_SIDE:
-                        hook_unconfirmed(f);
-                        this->insert(result); // If so, add the new point and break the inner loop
-                        all_confirmed_so_far = false;
-                        break;
-
-                    case CGAL::ON_ORIENTED_BOUNDARY:
-                        hook_confirmed(f);
-                        f->confirm(); // Otherwise, mark the facet as confirmed and continue
-                        confirmed++;
-                        break;
-
-                    case CGAL::ON_NEGATIVE_SIDE:
-                        std::cerr << "Failed vector test!" << std::endl;
-                        std::cerr << "Hyperplane: " << hp << std::endl;
-                        std::cerr << "Inner normal: " << innernormal << std::endl;
-                        std::cerr << "Found point: " << result << std::endl;
-                        std::cerr << "Found point score: " << std::inner_product(result.cartesian_begin(), result.cartesian_end(), innernormal.cartesian_begin(), CGAL::Gmpq(0)) << std::endl;
-                        FPoint known_v =  this->vertex_of_facet(f, 0)->point();
-                        std::cerr << "Example known vertex: " << known_v << std::endl;
-                        std::cerr << "Known vertex score: " << std::inner_product(known_v.cartesian_begin(), known_v.cartesian_end(), innernormal.cartesian_begin(), CGAL::Gmpq(0)) << std::endl << std::endl;
-                        f->confirm();
-                        break;
+            while (not unconfirmed.empty()) {
+                if (rounds) {
+                    if (test_round(unconfirmed, retired, confirmed)) {
+                        hook_perloop(confirmed);
                     }
+                    continue;
+                }
+
+                Facet_handle f = unconfirmed.front();
+                unconfirmed.pop_front();
+
+                if (f->is_confirmed() or retired.count(facet_key(f)) > 0) {
+                    continue;
+                }
+
+                Hyperplane hp = this->hyperplane_supporting(f);
+                FVector innernormal = -hp.orthogonal_vector(); // CGAL returns the outer normal
+                FPoint result = vertex_oracle(innernormal);
+                oracle_calls++;
+
+                switch (hp.oriented_side(result)) {
+                case CGAL::ON_POSITIVE_SIDE:
+                    hook_unconfirmed(f);
+                    insert_point(result, unconfirmed, retired); // If so, add the new point, which retires f
+                    hook_perloop(confirmed);
+                    break;
+
+                case CGAL::ON_ORIENTED_BOUNDARY:
+                    hook_confirmed(f);
+                    f->confirm(); // Otherwise, mark the facet as confirmed and continue
+                    confirmed++;
+                    break;
+
+                case CGAL::ON_NEGATIVE_SIDE:
+                    report_failed_test(f, hp, innernormal, result);
+                    f->confirm();
+                    break;
                 }
             }
         }
@@ -185,5 +213,142 @@ namespace iB4e
         hook_postloop();
         // END LOGIC
     };
+
+    template <typename F>
+        bool BBPolytope<F>::queue_unconfirmed_facets(std::deque<Facet_handle>& unconfirmed) {
+        // Queue every unconfirmed facet of the hull, returning true if there were any
+        for (Facet_iterator f = this->facets_begin(); f != this->facets_end(); f++) {
+            if (not f->is_confirmed()) {
+                unconfirmed.push_back(f);
+            }
+        }
+        return not unconfirmed.empty();
+    };
+
+    template <typename F>
+        bool BBPolytope<F>::test_round(std::deque<Facet_handle>& unconfirmed, std::set<const void*>& retired, int& confirmed) {
+        /*
+          Test every queued facet at once, running the oracles concurrently.
+          The hull only changes after all the results are in: facets are confirmed first,
+          and then the new points are inserted in facet order,
+          so the result does not depend on how the oracle calls were scheduled.
+          Returns true if any new point was found.
+        */
+        std::vector<Facet_handle> facets;
+        std::vector<Hyperplane> hyperplanes;
+        std::vector<FVector> innernormals;
+        for (Facet_handle f: unconfirmed) {
+            if (not f->is_confirmed() and retired.count(facet_key(f)) == 0) {
+                Hyperplane hp = this->hyperplane_supporting(f);
+                facets.push_back(f);
+                hyperplanes.push_back(hp);
+                innernormals.push_back(-hp.orthogonal_vector()); // CGAL returns the outer normal
+            }
+        }
+        unconfirmed.clear();
+
+        long tests = facets.size();
+        std::vector<FPoint> results(tests);
+        std::exception_ptr error;
+
+        // A single test keeps any parallelism inside the oracle instead
+#pragma omp parallel for schedule(dynamic) if (tests > 1)
+        for (long k = 0; k < tests; ++k) {
+            try {
+                results[k] = this->vertex_oracle(innernormals[k]);
+            } catch (...) {
+#pragma omp critical
+                {
+                    if (not error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        oracle_calls += tests;
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        std::vector<FPoint> new_points;
+        for (long k = 0; k < tests; ++k) {
+            switch (hyperplanes[k].oriented_side(results[k])) {
+            case CGAL::ON_POSITIVE_SIDE:
+                hook_unconfirmed(facets[k]);
+                // Neighbouring facets often find the same point
+                if (std::find(new_points.begin(), new_points.end(), results[k]) == new_points.end()) {
+                    new_points.push_back(results[k]);
+                }
+                break;
+
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                hook_confirmed(facets[k]);
+                facets[k]->confirm();
+                confirmed++;
+                break;
+
+            case CGAL::ON_NEGATIVE_SIDE:
+                report_failed_test(facets[k], hyperplanes[k], innernormals[k], results[k]);
+                facets[k]->confirm();
+                break;
+            }
+        }
+
+        // A point found from one facet may already lie inside the hull grown by an earlier one,
+        // in which case the insertion leaves the hull unchanged
+        for (const FPoint& point: new_points) {
+            insert_point(point, unconfirmed, retired);
+        }
+
+        return not new_points.empty();
+    };
+
+    template <typename F>
+        void BBPolytope<F>::insert_point(const FPoint& point, std::deque<Facet_handle>& unconfirmed, std::set<const void*>& retired) {
+        /*
+          Insert point into the hull and queue the facets this creates.
+          The facets visible from point leave the hull, and across each ridge which one of them shares
+          with a facet that stays, a new facet joins the ridge to point. The insertion does not disturb
+          the facets which stay, so they lead to the new facets afterwards.
+        */
+        std::list<Facet_handle> visible = this->facets_visible_from(point);
+
+        std::set<const void*> visible_keys;
+        for (Facet_handle f: visible) {
+            visible_keys.insert(facet_key(f));
+        }
+
+        std::vector< std::pair<Facet_handle, int> > horizon; // A facet which stays, and the index of its vertex across the ridge
+        for (Facet_handle f: visible) {
+            retired.insert(facet_key(f));
+            for (int i = 0; i < this->dimension(); ++i) {
+                Facet_handle g = this->opposite_facet(f, i);
+                if (visible_keys.count(facet_key(g)) == 0) {
+                    horizon.push_back(std::make_pair(g, this->index_of_vertex_in_opposite_facet(f, i)));
+                }
+            }
+        }
+
+        this->insert(point);
+
+        for (auto& ridge: horizon) {
+            unconfirmed.push_back(this->opposite_facet(ridge.first, ridge.second));
+        }
+    };
+
+    template <typename F>
+        void BBPolytope<F>::report_failed_test(Facet_handle facet, const Hyperplane& hp, const FVector& innernormal, const FPoint& result) {
+        // The oracle found a point beyond a facet of the hull, so it did not optimize the objective
+        std::cerr << "Failed vector test!" << std::endl;
+        std::cerr << "Hyperplane: " << hp << std::endl;
+        std::cerr << "Inner normal: " << innernormal << std::endl;
+        std::cerr << "Found point: " << result << std::endl;
+        std::cerr << "Found point score: " << std::inner_product(result.cartesian_begin(), result.cartesian_end(), innernormal.cartesian_begin(), CGAL::Gmpq(0)) << std::endl;
+        FPoint known_v =  this->vertex_of_facet(facet, 0)->point();
+        std::cerr << "Example known vertex: " << known_v << std::endl;
+        std::cerr << "Known vertex score: " << std::inner_product(known_v.cartesian_begin(), known_v.cartesian_end(), innernormal.cartesian_begin(), CGAL::Gmpq(0)) << std::endl << std::endl;
+    };
 }
 #endif
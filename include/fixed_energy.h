@@ -0,0 +1,118 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar
+
+#ifndef FIXED_ENERGY_H
+#define FIXED_ENERGY_H
+
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "rational.h"
+
+namespace pmfe {
+    class FixedEnergy {
+        /**
+           Energy stored as a signed 64-bit count of units of 1/scale, where the scale
+           is chosen per energy model so that every constant is an exact multiple of it.
+           Infinity is the largest representable value, so comparisons need no special cases.
+        **/
+    public:
+        explicit FixedEnergy(int64_t units = 0):
+            m_units(units)
+            {};
+
+        static FixedEnergy infinity() {
+            return FixedEnergy(INF);
+        };
+
+        bool isFinite() const {
+            return m_units != INF;
+        };
+
+        int64_t units() const {
+            return m_units;
+        };
+
+        double get_d() const { // Note that this is measured in units of 1/scale
+            if (isFinite()) {
+                return m_units;
+            } else {
+                return std::numeric_limits<double>::infinity();
+            }
+        };
+
+        FixedEnergy& operator+=(const FixedEnergy& rhs) {
+            if (rhs.m_units == INF) {
+                m_units = INF;
+            } else if (m_units != INF) {
+                m_units += rhs.m_units;
+            }
+            return *this;
+        };
+
+        friend FixedEnergy operator+(const FixedEnergy& lhs, const FixedEnergy& rhs) {
+            FixedEnergy result = lhs;
+            result += rhs;
+            return result;
+        };
+
+        FixedEnergy& operator-=(const FixedEnergy& rhs) {
+            if (rhs.m_units == INF) {
+                throw std::logic_error("Invalid arithmetic with ∞.");
+            } else if (m_units != INF) {
+                m_units -= rhs.m_units;
+            }
+            return *this;
+        };
+
+        friend FixedEnergy operator-(const FixedEnergy& lhs, const FixedEnergy& rhs) {
+            FixedEnergy result = lhs;
+            result -= rhs;
+            return result;
+        };
+
+        friend FixedEnergy operator*(const FixedEnergy& lhs, int rhs) {
+            if (lhs.m_units != INF) {
+                // The scale bound covers the products the energy model forms, so this only fails if it is wrong
+                int64_t units;
+                if (__builtin_mul_overflow(lhs.m_units, static_cast<int64_t>(rhs), &units) or units == INF) {
+                    throw std::overflow_error("Energy is too large for fixed-point representation.");
+                }
+                return FixedEnergy(units);
+            } else if (rhs != 0) {
+                return lhs;
+            } else {
+                throw std::logic_error("Invalid arithmetic with ∞.");
+            }
+        };
+
+        friend FixedEnergy operator*(int lhs, const FixedEnergy& rhs) {
+            return rhs * lhs;
+        };
+
+        friend bool operator==(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units == rhs.m_units; };
+        friend bool operator!=(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units != rhs.m_units; };
+        friend bool operator<(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units < rhs.m_units; };
+        friend bool operator<=(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units <= rhs.m_units; };
+        friend bool operator>(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units > rhs.m_units; };
+        friend bool operator>=(const FixedEnergy& lhs, const FixedEnergy& rhs) { return lhs.m_units >= rhs.m_units; };
+
+        friend std::ostream& operator<<(std::ostream& os, const FixedEnergy& energy);
+
+        // Largest magnitude a finite energy may reach without risking overflow in a sum
+        static const int64_t MAX_FINITE = std::numeric_limits<int64_t>::max() / 4;
+
+    protected:
+        static const int64_t INF = std::numeric_limits<int64_t>::max();
+        int64_t m_units;
+    };
+
+    // Conversions between exact rationals and energies measured in units of 1/scale
+    // The scale is ignored for Rational energies
+    Rational to_rational(const Rational& energy, const Integer& scale);
+    Rational to_rational(const FixedEnergy& energy, const Integer& scale);
+    void from_rational(const Rational& value, const Integer& scale, Rational& result);
+    void from_rational(const Rational& value, const Integer& scale, FixedEnergy& result);
+}
+#endif
@@ -8,7 +8,7 @@
 namespace pmfe{
     namespace fs = boost::filesystem;
 
-    RNAStructureWithScore mfe(fs::path seq_file, ParameterVector params, dangle_mode dangles = BOTH_DANGLE);
+    RNAStructureWithScore mfe(fs::path seq_file, ParameterVector params, dangle_mode dangles = BOTH_DANGLE, bool no_lonely_pairs = false);
     RNAStructureWithScore mfe(fs::path seq_file, dangle_mode dangles = BOTH_DANGLE);
 
     ScoreVector mfe_pywrap(std::string seq_file, ParameterVector params, int dangle_model = 1);
@@ -24,6 +24,7 @@
 
 #include "pmfe_types.h"
 #include "rational.h"
+#include "fixed_energy.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/multi_array.hpp>
@@ -34,37 +35,40 @@ namespace pmfe {
     namespace fs = boost::filesystem;
     //TODO: Make abstract
     //TODO: Provide Turner99 instance
-    class NNDBConstants {
+    template <typename E>
+    class BasicNNDBConstants {
     public:
-        Rational maxpen;
-        Rational auend;
-        Rational gubonus;
-        Rational cint; /* cint, cslope, c3 are used for poly C hairpin loops */
-        Rational cslope;
-        Rational c3;
+        E maxpen;
+        E auend;
+        E gubonus;
+        E cint; /* cint, cslope, c3 are used for poly C hairpin loops */
+        E cslope;
+        E c3;
         bool gail;
-        Rational prelog;
+        Rational prelog; /* Only used in the long-loop correction, which is computed exactly and then converted */
         ParameterVector params;
+        Integer scale; /* Energies are measured in units of 1/scale; this is 1 for Rational energies */
 
-        std::vector<Rational> poppen;
-        std::vector<Rational> multConst; /* for multiloop penalties. */
-        std::vector<Rational> inter; /* Contains size penalty for internal loops */
-        std::vector<Rational> bulge; /* Contain the size penalty for bulges */
-        std::vector<Rational> hairpin; /* Contains the size penalty for hairpin loops */
+        std::vector<E> poppen;
+        std::vector<E> multConst; /* for multiloop penalties. */
+        std::vector<E> inter; /* Contains size penalty for internal loops */
+        std::vector<E> bulge; /* Contain the size penalty for bulges */
+        std::vector<E> hairpin; /* Contains the size penalty for hairpin loops */
 
-        std::map<std::string, Rational> tloop;
+        std::map<std::string, E> tloop;
 
         //TODO: Rebase anything that should be 1-indexed
-        boost::multi_array<Rational, 4> tstkh; /* Terminal mismatch energy used in the calculations of hairpin loops */
-        boost::multi_array<Rational, 4> tstki; /* Terminal mismatch energy used in the calculations of internal loops */
-        boost::multi_array<Rational, 4> stack; /* Stacking energy used to calculate energy of stack loops */
-        boost::multi_array<Rational, 4> dangle; /* Contain dangling energy values */
-        boost::multi_array<Rational, 8> iloop22; /* 2*2 internal looops */
-        boost::multi_array<Rational, 7> iloop21; /* 2*1 internal loops */
-        boost::multi_array<Rational, 6> iloop11; /* 1*1 internal loops */
-
-    NNDBConstants(const ParameterVector params = ParameterVector()):
+        boost::multi_array<E, 4> tstkh; /* Terminal mismatch energy used in the calculations of hairpin loops */
+        boost::multi_array<E, 4> tstki; /* Terminal mismatch energy used in the calculations of internal loops */
+        boost::multi_array<E, 4> stack; /* Stacking energy used to calculate energy of stack loops */
+        boost::multi_array<E, 4> dangle; /* Contain dangling energy values */
+        boost::multi_array<E, 8> iloop22; /* 2*2 internal looops */
+        boost::multi_array<E, 7> iloop21; /* 2*1 internal loops */
+        boost::multi_array<E, 6> iloop11; /* 1*1 internal loops */
+
+    BasicNNDBConstants(const ParameterVector params = ParameterVector()):
         params(params),
+            scale(1),
             poppen(5),
             multConst(3),
             inter(31),
@@ -78,13 +82,31 @@ namespace pmfe {
             iloop21(boost::extents[5][5][5][5][5][5][5]),
             iloop11(boost::extents[5][5][5][5][5][5])
             {};
+
+        // Convert a set of exact constants to this energy type, measured in units of 1/scale
+        BasicNNDBConstants(const BasicNNDBConstants<Rational>& source, const Integer& scale);
     };
 
+    typedef BasicNNDBConstants<Rational> NNDBConstants;
+    typedef BasicNNDBConstants<FixedEnergy> FixedNNDBConstants;
+
+    // Return a scale at which every energy of these constants (and the extra value, if given)
+    // is an exact integer and no structure on a sequence of the given length can overflow
+    // a FixedEnergy, or 0 if there is no such scale
+    Integer fixed_point_scale(const NNDBConstants& constants, int length, const Rational& extra = Rational(0));
+
     class Turner99: public NNDBConstants {
     public:
+        // The parameter files in each directory are parsed once per process
+        // and later instances are derived from that copy without any file I/O
         Turner99(const ParameterVector& params = ParameterVector(), const fs::path& param_dir = fs::path(PMFE_PATH) / "Turner99");
 
     protected:
+        struct unscaled_tag {};
+        Turner99(unscaled_tag, const fs::path& param_dir); // Parse the files with unit dummy scaling
+
+        static const NNDBConstants& unscaled_constants(const fs::path& param_dir);
+
         void initMiscValues(const fs::path& param_dir);
         void initLoopValues(const fs::path& param_dir);
         void initTstkhValues(const fs::path& param_dir);
@@ -5,47 +5,72 @@
 #include "pmfe_types.h"
 #include "rational.h"
 
+#include <map>
+#include <stack>
+#include <unordered_map>
 #include <vector>
 
 
 namespace pmfe{
-    class NNTM {
+    template <typename E>
+    class BasicNNTM {
     public:
+        // Within the model, the energy-carrying types use the model's energy type
+        typedef BasicNNDBConstants<E> NNDBConstants;
+        typedef BasicRNASequenceWithTables<E> RNASequenceWithTables;
+        typedef BasicSegment<E> Segment;
+        typedef BasicRNAPartialStructure<E> RNAPartialStructure;
+        typedef std::stack<RNAPartialStructure> PartialStructureStack;
+
         const NNDBConstants& constants;
         const dangle_mode dangles;
+        const bool no_lonely_pairs; // Exclude structures with a pair stacked on neither side
 
-        NNTM(const NNDBConstants& constants, dangle_mode dangles);
+        BasicNNTM(const NNDBConstants& constants, dangle_mode dangles, bool no_lonely_pairs = false);
 
         RNASequenceWithTables energy_tables(const RNASequence& seq) const;
-        Rational minimum_energy(RNASequenceWithTables& seq) const;
+        E minimum_energy(RNASequenceWithTables& seq) const;
         RNAStructureWithScore mfe_structure(const RNASequenceWithTables& seq) const;
 
         ScoreVector score(const RNAStructure& structure, bool compute_w = true) const;
 
-        std::vector<RNAStructureWithScore> suboptimal_structures(RNASequenceWithTables& seq, Rational delta, bool sorted = false, bool transformed = false) const;
+        std::vector<RNAStructureWithScore> suboptimal_structures(RNASequenceWithTables& seq, Rational delta, bool sorted = false, bool transformed = false, bool verify = false) const;
+        void visit_suboptimal_structures(RNASequenceWithTables& seq, Rational delta, const StructureVisitor& visit, bool transformed = false, bool verify = false) const; // Hand each structure to visit as soon as it is complete; verify rescores it from scratch
+        void visit_best_suboptimal_structures(RNASequenceWithTables& seq, Rational delta, std::size_t count, const StructureVisitor& visit, bool transformed = false, bool verify = false) const; // Hand the count lowest-energy structures within delta to visit, in increasing energy order; delta may be infinite
+        void visit_shape_structures(RNASequenceWithTables& seq, Rational delta, const StructureVisitor& visit, bool transformed = false, bool verify = false) const; // Hand the lowest-energy structure of each abstract shape within delta to visit, in increasing energy order
+        EnergyHistogram count_suboptimal_structures(RNASequenceWithTables& seq, Rational delta) const; // Count the structures visit_suboptimal_structures would find at each energy, without building them
+        Rational delta_for_count(RNASequenceWithTables& seq, const Integer& count) const; // Find the largest delta whose suboptimal structures number at most count; throws if the minimum energy alone has more
+
+        Rational to_rational(const E& energy) const; // Convert an energy of this model to an exact rational
+        E from_rational(const Rational& value) const; // Convert an exact rational to an energy of this model
 
     protected:
         // MFE helpers
         void populate_energy_tables(RNASequenceWithTables& seq) const;
-        void populate_energy_tables(int i, int j, RNASequenceWithTables& seq) const;
+        void populate_energy_tables(int i, int j, RNASequenceWithTables& seq, E* generic_loops) const;
         void populate_subopt_tables(RNASequenceWithTables& seq) const;
         void populate_subopt_tables(int i, int j, RNASequenceWithTables& seq) const;
-        Rational Ed3(int i, int j, const RNASequence& seq, bool inside = false) const;
-        Rational Ed5(int i, int j, const RNASequence& seq, bool inside = false) const;
-        Rational auPenalty(int i, int j, const RNASequence& seq) const;
-        Rational eLL(int size) const;
-        Rational eL(int i, int j, int ip, int jp, const RNASequence& seq) const;
-        Rational eH(int i, int j, const RNASequence& seq) const;
-        Rational eS(int i, int j, const RNASequence& seq) const;
-        Rational calcVBI(int i, int j, const RNASequenceWithTables& seq) const;
+        E Ed3(int i, int j, const RNASequence& seq, bool inside = false) const;
+        E Ed5(int i, int j, const RNASequence& seq, bool inside = false) const;
+        E auPenalty(int i, int j, const RNASequence& seq) const;
+        E pairPenalty(int base_i, int base_j) const;
+        E eLL(int size) const;
+        E calcLongLoop(int size) const;
+        E loopGeometryEnergy(int base_i, int base_j, int base_ip, int base_jp, int size1, int size2) const;
+        E eL(int i, int j, int ip, int jp, const RNASequence& seq) const;
+        E eH(int i, int j, const RNASequence& seq) const;
+        E eS(int i, int j, const RNASequence& seq) const;
+        E eNinio(int lopsided, int pindex) const;
+        void extendGenericLoops(int i, int j, const RNASequenceWithTables& seq, E* generic_loops) const;
+        E calcVBI(int i, int j, const RNASequenceWithTables& seq, const E* generic_loops) const;
 
         // Traceback helpers
         bool traceW(int i, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
-        Rational traceV(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
-        Rational traceVM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
-        Rational traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
-        Rational traceWM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
-        Rational traceWMPrime(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
+        E traceV(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score, bool stacked = false) const; // If stacked, trace VP instead
+        E traceVM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
+        E traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
+        E traceWM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
+        E traceWMPrime(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const;
 
         // Scoring helpers
         ScoreVector scoreTree(const RNAStructureTree& tree) const; // Score a whole structure tree
@@ -55,16 +80,38 @@ namespace pmfe{
         ScoreVector scoreE(const RNAStructureTree& tree) const; // Compute the energy associated to the external loop node
 
         // Suboptimal structure helpers
-        bool subopt_process_top_structure(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
-        bool subopt_traceV(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
-        bool subopt_traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
-        bool subopt_traceW(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
-        bool subopt_traceM1(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
-        bool subopt_traceM(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const;
+        void subopt_best_first(RNASequenceWithTables& seq, Rational delta, std::size_t count, const StructureVisitor& visit, bool transformed, bool verify, bool distinct_shapes) const; // If distinct_shapes, skip structures whose shape has been visited
+        void subopt_expand(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound, const StructureVisitor& visit, bool transformed, bool verify) const;
+        bool subopt_process_top_structure(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const;
+        bool subopt_traceV(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound, bool stacked = false) const; // If stacked, trace VP instead
+        bool subopt_traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const;
+        bool subopt_traceW(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const;
+        bool subopt_traceM1(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const;
+        bool subopt_traceM(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const;
+
+        // Density of states helpers
+        typedef std::map<E, Integer> Density; // Number of structures of a segment at each energy above its minimum
+        struct DensityCache {
+            typename RNAPartialStructure::Arena arena; // Storage for the choices of the traceback
+            std::unordered_map<long, Density> densities; // Densities found so far, keyed by label, i and j
+        };
+        const Density& subopt_density(const Segment& seg, const RNASequenceWithTables& seq, E delta, DensityCache& cache) const;
+
+        // Loop energies precomputed from the constants
+        std::vector<E> long_loop_energies; // eLL(size) for 0 < size < LONG_LOOP_TABLE_SIZE
+        std::vector<E> loop_energies; // loopGeometryEnergy by outer pair type, inner pair type and the two sizes, up to MAXLOOP
+        std::vector<E> tetraloop_energies; // Special tetraloop bonuses, indexed by the six bases of the loop in base 4
 
         // Configurable constants
         const static int MAXLOOP = 30; /* The maximum loop size. */
+        const static int GENERIC_LOOP_SIZES = (MAXLOOP > 3) ? MAXLOOP - 3 : 0; /* Sizes 4 to MAXLOOP of internal loops with at least two bases on each side */
         const static int TURN = 3; /* Minimum size of a hairpin loop. */
+        const static int PAIR_TYPES = PAIR_NONE; /* Number of canonical base pairs. */
+        const static int LONG_LOOP_TABLE_SIZE = 1024; /* Loop sizes with a precomputed long loop correction. */
+        const static int MAX_COUNTED_DELTA = 1 << 20; /* Largest delta tried when choosing one by structure count. */
     };
+
+    typedef BasicNNTM<Rational> NNTM;
+    typedef BasicNNTM<FixedEnergy> FixedNNTM;
 };
 #endif
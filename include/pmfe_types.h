@@ -7,14 +7,20 @@
 #include <utility>
 #include <iostream>
 
+#include <cassert>
+#include <cstddef>
 #include <deque>
+#include <functional>
+#include <map>
+#include <memory>
 #include <stack>
+#include <vector>
 
 #include <boost/filesystem.hpp>
-#include "boost/multi_array.hpp"
 
 #include "interval_tree.h"
 #include "rational.h"
+#include "fixed_energy.h"
 
 namespace pmfe {
     extern const Rational multiloop_default;
@@ -31,12 +37,35 @@ namespace pmfe {
         BASE_U = 3,
     };
 
+    enum RNA_pair {
+        PAIR_AU = 0,
+        PAIR_CG = 1,
+        PAIR_GC = 2,
+        PAIR_GU = 3,
+        PAIR_UA = 4,
+        PAIR_UG = 5,
+        PAIR_NONE = 6,
+    };
+
+    inline int base_pair_type(int base_i, int base_j) {
+        // Return the RNA_pair formed by two bases
+        static const unsigned char types[4][4] = {
+            // A          C          G          U
+            {PAIR_NONE, PAIR_NONE, PAIR_NONE, PAIR_AU}, // A
+            {PAIR_NONE, PAIR_NONE, PAIR_CG, PAIR_NONE}, // C
+            {PAIR_NONE, PAIR_GC, PAIR_NONE, PAIR_GU}, // G
+            {PAIR_UA, PAIR_NONE, PAIR_UG, PAIR_NONE}, // U
+        };
+        return types[base_i][base_j];
+    }
+
     enum subopt_label {
         lW,
         lV,
         lVBI,
         lM,
         lM1,
+        lVP,
     };
 
     enum dangle_mode {
@@ -109,6 +138,10 @@ namespace pmfe {
         friend ScoreVector operator+(const ScoreVector& lhs, const ScoreVector& rhs);
     };
 
+    struct ScoreVectorHash {
+        std::size_t operator()(const ScoreVector& score) const; // Hash of a score vector for unordered containers
+    };
+
     Rational get_rational_from_word(std::string word);
 
     class RNASequence {
@@ -121,35 +154,106 @@ namespace pmfe {
         RNASequence(const fs::path& filename); // Construct from a FASTA file
 
         int len() const; // Return the length of the sequence
-        int base(int i) const; // Return the base at position i of the sequence
         std::string subsequence(int i, int j) const; // Return the subsequence starting at position i and ending at j
-        bool can_pair(int i, int j) const; // Return true if the bases at i and j are a valid pair
+
+        int base(int i) const { // Return the base at position i of the sequence
+            return codes[i];
+        };
+
+        int pair_type(int i, int j) const { // Return the RNA_pair formed by the bases at i and j
+            return base_pair_type(codes[i], codes[j]);
+        };
+
+        bool can_pair(int i, int j) const { // Return true if the bases at i and j are a valid pair
+            return pair_type(i, j) != PAIR_NONE;
+        };
+
+        bool poly_c(int i, int j) const; // Return true if every base strictly between i and j is a C
 
         char operator[](const int index) const; // Retrieve a single base using index notation
         friend std::ostream& operator<<(std::ostream& out, const RNASequence& sequence); // Output the sequence to an ostream
 
     protected:
         std::string seq_txt;
-        boost::multi_array<bool, 2> valid_pairs;
+        std::vector<unsigned char> codes; // The bases as RNA_base values
+        std::vector<int> c_counts; // c_counts[i] is the number of C bases before position i
         void preprocess();
+        static int encode_base(char base); // Return the RNA_base of a character, or -1 if it is not a base
     };
 
-    class RNASequenceWithTables: public RNASequence {
+    template <typename E>
+    class TriangularTable {
+        /**
+           Square table of which only the entries (i, j) with i <= j are stored.
+           The rows are packed one after another and table[i][j] addresses
+           entry (i, j) just as in a full len() x len() array.
+        **/
+    public:
+        template <typename T>
+        class Row {
+        public:
+        Row(T* origin, int i):
+            origin(origin),
+                i(i)
+                {};
+
+            T& operator[](int j) const {
+                assert (j >= i); // Entries below the diagonal are not stored
+                return origin[j];
+            };
+
+        protected:
+            T* origin; // Address that entry (i, 0) would have
+            int i;
+        };
+
+        TriangularTable(): m_size(0) {}; // Default constructor for compiler
+    TriangularTable(int size, const E& fill):
+        m_size(size),
+            m_data(static_cast<std::size_t>(size) * (size + 1) / 2, fill)
+            {};
+
+        Row<E> operator[](int i) {
+            assert (i >= 0 and i < m_size);
+            return Row<E>(m_data.data() + offset(i), i);
+        };
+
+        Row<const E> operator[](int i) const {
+            assert (i >= 0 and i < m_size);
+            return Row<const E>(m_data.data() + offset(i), i);
+        };
+
+        int size() const { return m_size; };
+        std::size_t num_elements() const { return m_data.size(); };
+
+    protected:
+        int m_size;
+        std::vector<E> m_data;
+
+        std::ptrdiff_t offset(int i) const {
+            // Rows before i hold i*m_size - i*(i-1)/2 entries and row i starts at column i
+            return static_cast<std::ptrdiff_t>(i) * m_size - static_cast<std::ptrdiff_t>(i) * (i + 1) / 2;
+        };
+    };
+
+    template <typename E>
+    class BasicRNASequenceWithTables: public RNASequence {
         /**
            Intermediate data store for NNTM dynamic programming results
         **/
     public:
-        RNASequenceWithTables() {}; // Default constructor for compiler
-        RNASequenceWithTables(const RNASequence& seq);
-
-        boost::multi_array<Rational, 1> W;
-        boost::multi_array<Rational, 2> V;
-        boost::multi_array<Rational, 2> VBI;
-        boost::multi_array<Rational, 2> VM;
-        boost::multi_array<Rational, 2> WM;
-        boost::multi_array<Rational, 2> WMPrime;
-        boost::multi_array<Rational, 2> FM;
-        boost::multi_array<Rational, 2> FM1;
+        BasicRNASequenceWithTables() {}; // Default constructor for compiler
+        BasicRNASequenceWithTables(const RNASequence& seq);
+
+        std::vector<E> W;
+        TriangularTable<E> V;
+        TriangularTable<E> VP; // With lonely pairs excluded, V for a pair stacked on (i-1, j+1), which may close any loop; empty otherwise
+        TriangularTable<E> VBI;
+        TriangularTable<E> VM;
+        TriangularTable<E> WM;
+        TriangularTable<E> WMPrime;
+        TriangularTable<E> FM;
+        TriangularTable<E> FM1;
 
         bool energy_tables_populated = false;
         bool subopt_tables_populated = false;
@@ -157,6 +261,8 @@ namespace pmfe {
         void print_debug();
     };
 
+    typedef BasicRNASequenceWithTables<Rational> RNASequenceWithTables;
+
     class RNAStructure {
         /**
            Representation of an RNA secondary structure
@@ -181,6 +287,7 @@ namespace pmfe {
 
         std::string string() const; // Return the structure as a new-style dots-and-braces string
         std::string old_string() const; // Return the structure as an old-style dots-and-braces string
+        std::string shape() const; // Return the abstract shape of the structure, which records only how its helices nest
 
         char operator[](const int index) const; // Retrieve a single base using index notation
         friend std::ostream& operator<<(std::ostream& out, const RNAStructure& structure); // Output this structure as an ostream
@@ -208,6 +315,14 @@ Representation of an RNA secondary structure that has been assigned a score
         ScoreVector transformedScore() const; // Transform score vector with transformation T(x, y, z, w) = (x, w, z - 3*x, w)
     };
 
+    typedef std::function<void(const RNAStructureWithScore&)> StructureVisitor; // Consumer of structures as they are enumerated
+    typedef std::map<Rational, Integer> EnergyHistogram; // Number of structures at each energy
+
+    struct ScoreSignature {
+        RNAStructureWithScore representative; // The first structure with this score in dot-bracket order
+        Integer count; // Number of structures with this score
+    };
+
     class RNAStructureTree: public RNAStructure {
     public:
         IntervalTreeNode root;
@@ -216,45 +331,159 @@ Representation of an RNA secondary structure that has been assigned a score
         RNAStructureTree(const RNAStructure& structure);
     };
 
-    class Segment {
+    template <typename E>
+    class BasicSegment {
         /**
            Representation of a segment in a suboptimal structure processing stack
          **/
     public:
         int i, j;
         subopt_label label;
-        Rational minimum_energy;
+        E minimum_energy;
+
+    BasicSegment():
+        i(0),
+            j(0),
+            label(lW)
+            {};
 
-    Segment(int i, int j, subopt_label label, Rational minimum_energy):
+    BasicSegment(int i, int j, subopt_label label, E minimum_energy):
         i(i),
             j(j),
             label(label),
             minimum_energy(minimum_energy)
             {};
 
-        friend std::ostream& operator<<(std::ostream& out, const Segment& seg); // Output this segment as an ostream
+        template <typename F>
+        friend std::ostream& operator<<(std::ostream& out, const BasicSegment<F>& seg); // Output this segment as an ostream
+    };
+
+    typedef BasicSegment<Rational> Segment;
+
+    template <typename T>
+    class NodePool {
+        /**
+           Allocator for reference-counted list nodes with a next pointer.
+           Nodes are carved out of fixed-size blocks, and nodes whose count drops to zero
+           are kept on a free list for reuse, so the pool only grows with the live nodes.
+           A pool is not thread-safe.
+        **/
+    public:
+    NodePool():
+        block_used(BLOCK_SIZE),
+            free_nodes(nullptr)
+            {};
+
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        T* allocate() { // Return a node with one reference and no successor
+            T* node;
+            if (free_nodes != nullptr) {
+                node = free_nodes;
+                free_nodes = node->next;
+            } else {
+                if (block_used == BLOCK_SIZE) {
+                    blocks.emplace_back(new T[BLOCK_SIZE]);
+                    block_used = 0;
+                }
+                node = &blocks.back()[block_used++];
+            }
+            node->next = nullptr;
+            node->refs = 1;
+            return node;
+        };
+
+        void release(T* node) { // Drop one reference to node, freeing it and its successors as they become unreachable
+            while (node != nullptr and --node->refs == 0) {
+                T* next = node->next;
+                node->next = free_nodes;
+                free_nodes = node;
+                node = next;
+            }
+        };
+
+    protected:
+        const static int BLOCK_SIZE = 1024;
+        std::vector< std::unique_ptr<T[]> > blocks;
+        int block_used; // Nodes handed out from the last block
+        T* free_nodes;
+    };
+
+    template <typename E>
+    class BasicPartialStructureArena {
+        /**
+           Shared storage for the partial structures of one suboptimal structure enumeration.
+           It must outlive every partial structure which uses it.
+        **/
+    public:
+        struct SegmentNode {
+            BasicSegment<E> seg;
+            SegmentNode* next; // The rest of the segment stack
+            int refs;
+        };
+
+        struct MarkNode {
+            int i, j; // The pair (i, j), or a dangle at i with j < 0
+            char symbol;
+            MarkNode* next; // The earlier marks
+            int refs;
+        };
+
+        NodePool<SegmentNode> segment_nodes;
+        NodePool<MarkNode> mark_nodes;
     };
 
-    class RNAPartialStructure: public RNAStructure {
+    template <typename E>
+    class BasicRNAPartialStructure {
         /**
            Representation of a partial RNA secondary structure
+
+           The segment stack and the marked pairs and dangles are immutable linked lists shared
+           with the partial structures this one was copied from, so copying, pushing and marking
+           all take constant time and memory.
         **/
     public:
-        RNAPartialStructure(); // Default constructor for compiler
-        RNAPartialStructure(const RNASequence& seq, Rational known_energy = 0); // Construct a (blank) structure from a given sequence with specified energy
+        typedef BasicPartialStructureArena<E> Arena;
+
+        BasicRNAPartialStructure(); // Default constructor for compiler
+        BasicRNAPartialStructure(const RNASequence& seq, Arena& arena, E known_energy = E(0)); // Construct a (blank) structure from a given sequence with specified energy
+        BasicRNAPartialStructure(const BasicRNAPartialStructure& other);
+        BasicRNAPartialStructure(BasicRNAPartialStructure&& other);
+        BasicRNAPartialStructure& operator=(BasicRNAPartialStructure other);
+        ~BasicRNAPartialStructure();
+
+        int len() const; // Return the length of the sequence
 
-        void accumulate(Rational energy); // Add to the known energy
-        Rational total() const; // Return the known energy
-        void push(const Segment& seg); // Push a segment onto the stack
+        void mark_pair(int i, int j); // Record that (i, j) are paired
+        void mark_d5(int i); // Record that i dangles from the 5' end of i+1
+        void mark_d3(int i); // Record that i dangles from the 3' end of i-1
+        RNAStructure structure() const; // Return the pairs and dangles marked so far as a structure
+        std::string shape() const; // Return the abstract shape of the marked pairs, with the pending segments in place
+        BasicRNAPartialStructure adopted(Arena& arena) const; // Return a copy whose lists are allocated from another arena
+
+        void accumulate(E energy, int multiloops = 0, int unpaired = 0, int branches = 0); // Add to the known energy, which includes the given numbers of multiloop, unpaired base and branch penalties
+        E total() const; // Return the known energy
+        int multiloop_count() const; // Return the number of multiloop penalties in the known energy
+        int unpaired_count() const; // Return the number of unpaired base penalties in the known energy
+        int branch_count() const; // Return the number of branch penalties in the known energy
+        void push(const BasicSegment<E>& seg); // Push a segment onto the stack
         void pop(); // Remove a segment from the stack
-        Segment top() const; // Retrieve the top segment of the stack
+        BasicSegment<E> top() const; // Retrieve the top segment of the stack
         bool empty() const; // True if the stack is empty
 
     protected:
-        std::stack<Segment> seg_stack;
-        Rational known_energy;
+        const RNASequence* seq;
+        Arena* arena;
+        typename Arena::SegmentNode* segments;
+        typename Arena::MarkNode* marks;
+        E known_energy;
+        int multiloops, unpaired, branches;
+
+        void mark(int i, int j, char symbol);
     };
 
+    typedef BasicRNAPartialStructure<Rational> RNAPartialStructure;
     typedef std::stack<RNAPartialStructure> PartialStructureStack;
 
     dangle_mode convert_to_dangle_mode(int n);
@@ -4,6 +4,8 @@
 #define DPENERGY_H
 
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include <gmpxx.h>
 #include <CGAL/Gmpq.h>
@@ -12,44 +14,90 @@ namespace pmfe {
     typedef mpz_class Integer;
 
     class Rational {
+        /**
+           Exact rational number, extended by ∞.
+
+           Values whose canonical numerator and denominator fit in a long are kept inline
+           and handled without GMP. Anything larger is promoted to a shared, immutable
+           mpq_class, and results are demoted again whenever they fit.
+           ∞ is stored inline as 1/0, so the inline comparisons need no finiteness checks.
+        **/
     public:
     Rational():
-        m_value(0),
-            m_isFinite(true)
+        m_num(0),
+            m_den(1)
             {};
 
-    Rational(mpq_class energy):
-        m_value(energy),
-            m_isFinite(true)
-            {};
+    Rational(mpq_class energy) {
+        energy.canonicalize();
+        set(energy);
+    };
 
-    Rational(Integer num, Integer den = 1):
-        m_value(num, den),
-            m_isFinite(true)
-            {};
+    Rational(Integer num, Integer den = 1) {
+        mpq_class value(num, den);
+        value.canonicalize();
+        set(value);
+    };
 
-    Rational(std::string word):
-        m_value(word),
-            m_isFinite(true)
-            {};
+    Rational(std::string word) {
+        mpq_class value(word);
+        value.canonicalize();
+        set(value);
+    };
 
     Rational(int val):
-        m_value(val),
-            m_isFinite(true)
+        m_num(val),
+            m_den(1)
             {};
 
         static Rational infinity();
 
-        bool isFinite() const;
+        bool isFinite() const {
+            return m_den != 0;
+        };
+
         double get_d() const;
         void canonicalize();
         std::string get_str(int base = 10) const;
 
-        Rational& operator+=(const Rational& rhs);
-        friend Rational operator+(const Rational& lhs, const Rational& rhs);
-
-        Rational& operator-=(const Rational& rhs);
-        friend Rational operator-(const Rational& lhs, const Rational& rhs);
+        Rational& operator+=(const Rational& rhs) {
+            // Fast path: two inline values with the same finite denominator
+            long sum;
+            if (not m_big and not rhs.m_big and m_den == rhs.m_den and m_den != 0 and
+                not __builtin_add_overflow(m_num, rhs.m_num, &sum)) {
+                m_num = sum;
+                if (m_den != 1) {
+                    reduce();
+                }
+                return *this;
+            }
+            return add_slow(rhs, false);
+        };
+
+        friend Rational operator+(const Rational& lhs, const Rational& rhs) {
+            Rational result = lhs;
+            result += rhs;
+            return result;
+        };
+
+        Rational& operator-=(const Rational& rhs) {
+            long difference;
+            if (not m_big and not rhs.m_big and m_den == rhs.m_den and m_den != 0 and
+                not __builtin_sub_overflow(m_num, rhs.m_num, &difference)) {
+                m_num = difference;
+                if (m_den != 1) {
+                    reduce();
+                }
+                return *this;
+            }
+            return add_slow(rhs, true);
+        };
+
+        friend Rational operator-(const Rational& lhs, const Rational& rhs) {
+            Rational result = lhs;
+            result -= rhs;
+            return result;
+        };
 
         Rational& operator*=(const Rational& rhs);
         friend Rational operator*(const Rational& lhs, const Rational& rhs);
@@ -57,12 +105,45 @@ namespace pmfe {
         Rational& operator/=(const Rational& rhs);
         friend Rational operator/(const Rational& lhs, const Rational& rhs);
 
-        friend bool operator==(const Rational& lhs, const Rational& rhs);
-        friend bool operator!=(const Rational& lhs, const Rational& rhs);
-        friend bool operator<(const Rational& lhs, const Rational& rhs);
-        friend bool operator<=(const Rational& lhs, const Rational& rhs);
-        friend bool operator>(const Rational& lhs, const Rational& rhs);
-        friend bool operator>=(const Rational& lhs, const Rational& rhs);
+        friend bool operator==(const Rational& lhs, const Rational& rhs) {
+            // Both representations are canonical, so an inline value never equals a promoted one
+            if (lhs.m_big or rhs.m_big) {
+                return lhs.m_big and rhs.m_big and *lhs.m_big == *rhs.m_big;
+            }
+            return lhs.m_num == rhs.m_num and lhs.m_den == rhs.m_den;
+        };
+
+        friend bool operator!=(const Rational& lhs, const Rational& rhs) {
+            return not (lhs == rhs);
+        };
+
+        friend bool operator<(const Rational& lhs, const Rational& rhs) {
+            // Cross-multiplication orders ∞ = 1/0 above every finite value and not below itself
+            if (not lhs.m_big and not rhs.m_big) {
+                if (lhs.m_den == rhs.m_den) {
+                    return lhs.m_num < rhs.m_num;
+                }
+
+                long left, right;
+                if (not __builtin_mul_overflow(lhs.m_num, rhs.m_den, &left) and
+                    not __builtin_mul_overflow(rhs.m_num, lhs.m_den, &right)) {
+                    return left < right;
+                }
+            }
+            return less_slow(lhs, rhs);
+        };
+
+        friend bool operator<=(const Rational& lhs, const Rational& rhs) {
+            return not (rhs < lhs);
+        };
+
+        friend bool operator>(const Rational& lhs, const Rational& rhs) {
+            return (rhs < lhs);
+        };
+
+        friend bool operator>=(const Rational& lhs, const Rational& rhs) {
+            return not (lhs < rhs);
+        };
 
         friend std::ostream& operator<<(std::ostream& os, const Rational& energy);
 
@@ -70,8 +151,16 @@ namespace pmfe {
         operator CGAL::Gmpq() const;
 
     protected:
-        mpq_class m_value;
-        bool m_isFinite;
+        long m_num;
+        long m_den; // Always positive for finite values; 0 marks ∞
+        std::shared_ptr<const mpq_class> m_big; // Set only when the value does not fit inline
+
+        void set(const mpq_class& value); // Store a canonical value, inline if possible
+        mpq_class get_mpq() const; // Finite values only
+        void reduce(); // Restore the canonical form of an inline value
+
+        Rational& add_slow(const Rational& rhs, bool subtract);
+        static bool less_slow(const Rational& lhs, const Rational& rhs);
     };
 }
 #endif
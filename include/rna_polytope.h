@@ -41,12 +41,13 @@ namespace pmfe {
         ScoreVector classical_scores;
         RNASequence sequence;
         dangle_mode dangles;
+        bool no_lonely_pairs;
         std::map<FPoint, RNAStructureWithScore, compare_fp> structures;
         Rational multiloop_weight;
         bool scale_b_param;
 
-        RNAPolytope(RNASequence sequence, dangle_mode dangles, Rational multiloop_weight);
-        RNAPolytope(RNASequence sequence, dangle_mode dangles);
+        RNAPolytope(RNASequence sequence, dangle_mode dangles, bool no_lonely_pairs);
+        RNAPolytope(RNASequence sequence, dangle_mode dangles, bool no_lonely_pairs, Rational multiloop_weight); // b-slice with fixed multiloop weight
 
         BBP::FPoint vertex_oracle(BBP::FVector objective);
         void write_to_file(const fs::path poly_file) const;
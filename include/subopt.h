@@ -5,6 +5,24 @@
 #define _SUBOPT_H_
 
 namespace pmfe{
-    std::vector<RNAStructureWithScore> suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool sorted = false, bool transform = false);
+    std::vector<RNAStructureWithScore> suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool sorted = false, bool transform = false, bool verify = false, bool no_lonely_pairs = false);
+
+    // Hand each suboptimal structure to visit as soon as it is found, in enumeration order
+    void visit_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform = false, bool verify = false, bool no_lonely_pairs = false);
+
+    // Hand the count lowest-energy suboptimal structures to visit, in increasing energy order
+    void visit_best_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, std::size_t count, const StructureVisitor& visit, bool transform = false, bool verify = false, bool no_lonely_pairs = false);
+
+    // Hand the lowest-energy suboptimal structure of each abstract shape to visit, in increasing energy order
+    void visit_shape_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform = false, bool verify = false, bool no_lonely_pairs = false);
+
+    // Group the suboptimal structures by score vector, in increasing score order
+    std::vector<ScoreSignature> suboptimal_signatures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool transform = false, bool verify = false, bool no_lonely_pairs = false);
+
+    // Count the suboptimal structures at each energy without enumerating them
+    EnergyHistogram count_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool no_lonely_pairs = false);
+
+    // Find the largest delta within which there are at most count suboptimal structures
+    Rational suboptimal_delta_for_count(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Integer& count, bool no_lonely_pairs = false);
 }
 #endif
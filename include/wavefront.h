@@ -0,0 +1,93 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar
+
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace pmfe {
+    template <typename F>
+        class TiledWavefront {
+        /*
+          Scheduler for interval DP tables in which cell (i, j) depends only on cells (p, q) with i <= p <= q <= j.
+          The upper triangle is cut into square tiles, and a tile becomes runnable as soon as the tile to its left
+          and the tile below it are done. Runnable tiles are handed to the OpenMP task scheduler, so no thread waits
+          on a barrier while another thread still has work.
+        */
+    public:
+        TiledWavefront(int len, int min_span, F fill_cell, int tile_size = 16):
+            len(len),
+            min_span(min_span),
+            tile_size(tile_size),
+            tiles((len + tile_size - 1) / tile_size),
+            fill_cell(fill_cell),
+            pending(tiles * tiles)
+            {};
+
+        void run() {
+            // Diagonal tiles have no prerequisites; every other tile waits on two
+            for (int I = 0; I < tiles; ++I) {
+                for (int J = I; J < tiles; ++J) {
+                    pending[I * tiles + J] = (I == J) ? 0 : 2;
+                }
+            }
+
+#pragma omp parallel
+#pragma omp single
+            {
+                for (int I = 0; I < tiles; ++I) {
+                    spawn(I, I);
+                }
+            }
+        };
+
+    protected:
+        int len;
+        int min_span;
+        int tile_size;
+        int tiles;
+        F fill_cell;
+        std::vector< std::atomic<int> > pending; // Unfinished prerequisites of each tile
+
+        void spawn(int I, int J) {
+#pragma omp task firstprivate(I, J)
+            {
+                fill_tile(I, J);
+
+                // Release the tiles to the right and above
+                if (J + 1 < tiles and --pending[I * tiles + J + 1] == 0) {
+                    spawn(I, J + 1);
+                }
+
+                if (I > 0 and --pending[(I - 1) * tiles + J] == 0) {
+                    spawn(I - 1, J);
+                }
+            }
+        };
+
+        void fill_tile(int I, int J) {
+            // Increasing j and decreasing i visits (i, j-1) and (i+1, j) before (i, j)
+            int ilo = I * tile_size;
+            int ihi = std::min(len, ilo + tile_size) - 1;
+            int jlo = J * tile_size;
+            int jhi = std::min(len, jlo + tile_size) - 1;
+
+            for (int j = jlo; j <= jhi; ++j) {
+                for (int i = std::min(ihi, j - min_span); i >= ilo; --i) {
+                    fill_cell(i, j);
+                }
+            }
+        };
+    };
+
+    template <typename F>
+    void tiled_wavefront(int len, int min_span, F fill_cell) {
+        // Call fill_cell(i, j) for every 0 <= i, i + min_span <= j < len, respecting the interval dependencies
+        TiledWavefront<F> wavefront(len, min_span, fill_cell);
+        wavefront.run();
+    }
+}
+
+#endif
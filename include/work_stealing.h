@@ -0,0 +1,152 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar
+
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+namespace pmfe {
+    template <typename Item, typename Expand, typename Adopt>
+        class WorkStealingTraversal {
+        /*
+          Depth-first traversal of a tree of work items by a team of OpenMP threads.
+          Each thread keeps a deque of pending items and expands its newest one, while a thread which runs dry
+          steals the oldest item of another thread, which usually roots the largest remaining subtree.
+
+          expand(thread, item, children) appends the children of item, in the order a stack would push them.
+          adopt(thread, item) copies a stolen item into the storage of the thief. The stolen original is handed
+          back to its owner to be destroyed, so no per-thread storage is ever touched by two threads.
+        */
+    public:
+        WorkStealingTraversal(int threads, Expand expand, Adopt adopt):
+            threads(threads),
+            expand(expand),
+            adopt(adopt),
+            workers(threads),
+            pending(0),
+            failed(false)
+            {};
+
+        void run(Item root) {
+            workers[0].items.push_back(std::move(root));
+            pending = 1;
+
+#pragma omp parallel num_threads(threads)
+            {
+                int me = omp_get_thread_num();
+                try {
+                    work(me);
+                } catch (...) {
+#pragma omp critical
+                    {
+                        if (not error) {
+                            error = std::current_exception();
+                        }
+                    }
+                    failed = true;
+                }
+            }
+
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        };
+
+    protected:
+        struct Worker {
+            std::mutex lock;
+            std::deque<Item> items;
+            std::vector<Item> released; // Items stolen from this worker, to be destroyed by it
+        };
+
+        int threads;
+        Expand expand;
+        Adopt adopt;
+        std::vector<Worker> workers;
+        std::atomic<long> pending; // Items queued or being expanded
+        std::atomic<bool> failed;
+        std::exception_ptr error;
+
+        void work(int me) {
+            Worker& own = workers[me];
+            std::vector<Item> children;
+            std::chrono::microseconds backoff(1);
+
+            while (not failed) {
+                Item item;
+                if (not take(me, item) and not steal(me, item)) {
+                    if (pending == 0) {
+                        break;
+                    }
+                    // Back off while other threads are busy, rather than spinning on their locks
+                    std::this_thread::sleep_for(backoff);
+                    backoff = std::min(2 * backoff, std::chrono::microseconds(1000));
+                    continue;
+                }
+                backoff = std::chrono::microseconds(1);
+
+                children.clear();
+                expand(me, item, children);
+
+                {
+                    // Count the children before they can be stolen and retired, so pending never drops to zero early
+                    std::lock_guard<std::mutex> guard(own.lock);
+                    pending += children.size();
+                    own.released.clear();
+                    for (Item& child: children) {
+                        own.items.push_back(std::move(child));
+                    }
+                }
+
+                --pending;
+            }
+        };
+
+        bool take(int me, Item& item) {
+            Worker& own = workers[me];
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.released.clear();
+
+            if (own.items.empty()) {
+                return false;
+            }
+
+            item = std::move(own.items.back());
+            own.items.pop_back();
+            return true;
+        };
+
+        bool steal(int me, Item& item) {
+            for (int k = 1; k < threads; ++k) {
+                Worker& victim = workers[(me + k) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+
+                if (not victim.items.empty()) {
+                    item = adopt(me, victim.items.front());
+                    victim.released.push_back(std::move(victim.items.front()));
+                    victim.items.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        };
+    };
+
+    template <typename Item, typename Expand, typename Adopt>
+    void work_stealing_traversal(int threads, Item root, Expand expand, Adopt adopt) {
+        // Expand root and all of its descendants on a team of threads
+        WorkStealingTraversal<Item, Expand, Adopt> traversal(threads, expand, adopt);
+        traversal.run(std::move(root));
+    }
+}
+
+#endif
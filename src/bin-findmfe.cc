@@ -30,6 +30,7 @@ int main(int argc, char * argv[]) {
         ("branch-penalty,c", po::value<std::string>(), "Branching helix penalty parameter")
         ("dummy-scaling,d", po::value<std::string>(), "Dummy scaling parameter")
         ("dangle-model,m", po::value<int>()->default_value(1), "Dangle model")
+        ("no-lonely-pairs", po::bool_switch()->default_value(false), "Exclude structures with isolated base pairs")
         ("num-threads,t", po::value<int>()->default_value(0), "Number of threads")
         ("transform-input,I", po::bool_switch()->default_value(false), "Input a, b, c, d is transformed")
         ("transform-output,O", po::bool_switch()->default_value(false), "Transform structure output")
@@ -93,8 +94,9 @@ int main(int argc, char * argv[]) {
 
     // Setup dangle model
     pmfe::dangle_mode dangles = pmfe::convert_to_dangle_mode(vm["dangle-model"].as<int>());
+    bool no_lonely_pairs = vm["no-lonely-pairs"].as<bool>();
 
-    pmfe::RNAStructureWithScore result = pmfe::mfe(seq_file, params, dangles);
+    pmfe::RNAStructureWithScore result = pmfe::mfe(seq_file, params, dangles, no_lonely_pairs);
 
     result.transformed = vm["transform-output"].as<bool>();;
 
@@ -28,8 +28,10 @@ int main(int argc, char * argv[]) {
         ("verbose,v", po::bool_switch()->default_value(false), "Write verbose debugging output")
         ("outfile,o", po::value<std::string>(), "Output file")
         ("dangle-model,m", po::value<int>()->default_value(1), "Dangle model")
+        ("no-lonely-pairs", po::bool_switch()->default_value(false), "Exclude structures with isolated base pairs")
         ("num-threads,t", po::value<int>()->default_value(0), "Number of threads")
         ("b-parameter,b", po::value<std::string>()->default_value(""), "B Parameter")
+        ("parallel-oracle", po::bool_switch()->default_value(false), "Test all unconfirmed facets in rounds, running their oracle calls in parallel")
         ("help,h", "Display this help message")
         ;
 
@@ -61,6 +63,7 @@ int main(int argc, char * argv[]) {
 
     // Set up dangle model
     pmfe::dangle_mode dangles = pmfe::convert_to_dangle_mode(vm["dangle-model"].as<int>());
+    bool no_lonely_pairs = vm["no-lonely-pairs"].as<bool>();
 
     //Set up sequence
     fs::path seq_file (vm["sequence"].as<std::string>());
@@ -68,10 +71,10 @@ int main(int argc, char * argv[]) {
 
     std::string bParam = vm["b-parameter"].as<std::string>();
     pmfe::RNAPolytope poly = (bParam != "") ? 
-        pmfe::RNAPolytope(sequence, dangles, pmfe::Rational(bParam)) : 
-        pmfe::RNAPolytope(sequence, dangles);
+        pmfe::RNAPolytope(sequence, dangles, no_lonely_pairs, pmfe::Rational(bParam)) : 
+        pmfe::RNAPolytope(sequence, dangles, no_lonely_pairs);
     
-    poly.build();
+    poly.build(vm["parallel-oracle"].as<bool>());
 
     poly.print_statistics();
 
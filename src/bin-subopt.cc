@@ -1,8 +1,11 @@
 // Copyright (c) 2015 Andrew Gainer-Dewar.
 
+#include <algorithm>
 #include <iostream>
 #include <omp.h>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "boost/filesystem.hpp"
 #include "boost/filesystem/fstream.hpp"
@@ -27,16 +30,23 @@ int main(int argc, char* argv[]) {
         ("sequence", po::value<std::string>()->required(), "Sequence file")
         ("verbose,v", po::bool_switch()->default_value(false), "Write verbose debugging output")
         ("outfile,o", po::value<std::string>(), "Output file")
-        ("delta", po::value<std::string>()->default_value("0"), "Energy delta value")
+        ("delta", po::value<std::string>(), "Energy delta value (default 0, or unbounded with --top-k)")
         ("multiloop-penalty,a", po::value<std::string>(), "Multiloop penalty parameter")
         ("unpaired-penalty,b", po::value<std::string>(), "Unpaired base penalty parameter")
         ("branch-penalty,c", po::value<std::string>(), "Branching helix penalty parameter")
         ("dummy-scaling,d", po::value<std::string>(), "Dummy scaling parameter")
         ("dangle-model,m", po::value<int>()->default_value(1), "Dangle model")
+        ("no-lonely-pairs", po::bool_switch()->default_value(false), "Exclude structures with isolated base pairs")
         ("sorted,s", po::bool_switch(), "Sort results in increasing energy order")
-        ("num-threads,t", po::value<int>()->default_value(0), "Number of threads")
+        ("num-threads,t", po::value<int>()->default_value(0), "Number of threads (unsorted output order varies between runs with more than one)")
         ("transformed-input,I", po::bool_switch()->default_value(false), "Input a, b, c, d is transformed")
         ("transform-output,O", po::bool_switch()->default_value(false), "Transform structure output")
+        ("verify", po::bool_switch()->default_value(false), "Rescore each structure from scratch to check its score")
+        ("top-k,k", po::value<std::size_t>(), "Find only the given number of lowest-energy structures, in increasing energy order")
+        ("signatures", po::bool_switch()->default_value(false), "List each distinct score vector once, with the number of structures having it")
+        ("shapes", po::bool_switch()->default_value(false), "Find only the lowest-energy structure of each abstract shape within delta, in increasing energy order")
+        ("max-structures", po::value<std::size_t>(), "Choose the largest delta with at most this many structures")
+        ("count-only", po::bool_switch()->default_value(false), "Count the structures at each energy instead of listing them")
         ("help,h", "Display this help message")
         ;
 
@@ -52,6 +62,33 @@ int main(int argc, char* argv[]) {
 
     po::notify(vm);
 
+    // Each listing has its own output format and order, so at most one of them can be chosen
+    std::vector<std::string> listings;
+    if (vm.count("top-k")) {
+        listings.push_back("top-k");
+    }
+    for (const char* option: {"count-only", "signatures", "shapes", "sorted"}) {
+        if (vm[option].as<bool>()) {
+            listings.push_back(option);
+        }
+    }
+
+    if (listings.size() > 1) {
+        std::stringstream error_message;
+        error_message << "Option --" << listings[0] << " cannot be combined with --" << listings[1] << ".";
+        throw std::invalid_argument(error_message.str());
+    }
+
+    // Counting never builds a structure, so there is nothing to rescore
+    if (vm["count-only"].as<bool>() and vm["verify"].as<bool>()) {
+        throw std::invalid_argument("Option --count-only cannot be combined with --verify.");
+    }
+
+    // A delta chosen from the structure counts would override the given one
+    if (vm.count("max-structures") and vm.count("delta")) {
+        throw std::invalid_argument("Option --max-structures cannot be combined with --delta.");
+    }
+
     // Process thread-related options
     size_t num_threads = (vm["num-threads"].as<int>());
     omp_set_num_threads(num_threads);
@@ -77,7 +114,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Set up the parameters
-    pmfe::Rational delta = pmfe::get_rational_from_word(vm["delta"].as<std::string>());
+    // Without an explicit delta, the best-first search is bounded only by the number of structures
+    pmfe::Rational delta = 0;
+    if (vm.count("delta")) {
+        delta = pmfe::get_rational_from_word(vm["delta"].as<std::string>());
+    } else if (vm.count("top-k")) {
+        delta = pmfe::Rational::infinity();
+    }
 
     pmfe::ParameterVector params = pmfe::ParameterVector();
 
@@ -105,18 +148,23 @@ int main(int argc, char* argv[]) {
 
     bool sorted = vm["sorted"].as<bool>();
     bool transform = vm["transform-output"].as<bool>();
+    bool verify = vm["verify"].as<bool>();
+    bool count_only = vm["count-only"].as<bool>();
+    bool signatures = vm["signatures"].as<bool>();
+    bool shapes = vm["shapes"].as<bool>();
 
     // Set up dangle model
     pmfe::dangle_mode dangles = pmfe::convert_to_dangle_mode(vm["dangle-model"].as<int>());
+    bool no_lonely_pairs = vm["no-lonely-pairs"].as<bool>();
 
-    // Get results
-    
-    std::vector<pmfe::RNAStructureWithScore> structures = suboptimal_structures(seq_file, params, dangles, delta, sorted, transform);
-
-    // Print some status information
-    std::cout << "Found " << structures.size() << " suboptimal structures." << std::endl;
+    // Choose delta from the structure counts, if requested
+    if (vm.count("max-structures")) {
+        pmfe::Integer max_structures = static_cast<unsigned long>(vm["max-structures"].as<std::size_t>());
+        delta = pmfe::suboptimal_delta_for_count(seq_file, params, dangles, max_structures, no_lonely_pairs);
+        std::cout << "Chose delta " << delta << " ≈ " << delta.get_d() << "." << std::endl;
+    }
 
-    // Write out suboptimal structures
+    // Open the output file before enumerating, so structures can be written as they are found
     fs::ofstream outfile(out_file);
 
     if (!outfile.is_open()) {
@@ -125,22 +173,90 @@ int main(int argc, char* argv[]) {
         throw std::invalid_argument(error_message.str());
     }
 
-    // If input was transformed, transform back
+    // If input was transformed, report the parameters transformed back
+    pmfe::ParameterVector output_params = params;
     if (vm["transformed-input"].as<bool>()) {
-        params.transform_params();
+        output_params.transform_params();
     };
 
     outfile << "#\tSuboptimal secondary structures within " << delta.get_d() << " of minimum energy." << std::endl;
     outfile << "#\tCoefficients:\t" <<
-        "a = " << params.multiloop_penalty << " ≈ " << params.multiloop_penalty.get_d() << ",\t" <<
-        "b = " << params.unpaired_penalty << " ≈ " << params.unpaired_penalty.get_d() << ",\t" <<
-        "c = " << params.branch_penalty << " ≈ " << params.branch_penalty.get_d() << ",\t" <<
-        "d = " << params.dummy_scaling << " ≈ " << params.dummy_scaling.get_d() << "." << std::endl;
+        "a = " << output_params.multiloop_penalty << " ≈ " << output_params.multiloop_penalty.get_d() << ",\t" <<
+        "b = " << output_params.unpaired_penalty << " ≈ " << output_params.unpaired_penalty.get_d() << ",\t" <<
+        "c = " << output_params.branch_penalty << " ≈ " << output_params.branch_penalty.get_d() << ",\t" <<
+        "d = " << output_params.dummy_scaling << " ≈ " << output_params.dummy_scaling.get_d() << "." << std::endl;
 
     pmfe::RNASequence seq(seq_file);
+
+    if (count_only) {
+        // Report the number of structures at each energy, and the running total up to it
+        outfile << "#\t" << seq << std::endl;
+        outfile << "#\tEnergy\tStructures\tCumulative" << std::endl << std::endl;
+
+        pmfe::EnergyHistogram histogram = pmfe::count_suboptimal_structures(seq_file, params, dangles, delta, no_lonely_pairs);
+        pmfe::Integer total = 0;
+        for (auto& level: histogram) {
+            total += level.second;
+            outfile << level.first << "\t" << level.second << "\t" << total << "\t≅ " << level.first.get_d() << "\n";
+        }
+        outfile.flush();
+
+        std::cout << "Found " << total << " suboptimal structures." << std::endl;
+        return 0;
+    }
+
+    if (signatures) {
+        // Write one representative structure per score vector, after the number of structures sharing it
+        outfile << "#\tStructures\t" << seq << "\tM\tU\tB\tw\tEnergy" << std::endl << std::endl;
+
+        std::vector<pmfe::ScoreSignature> classes = pmfe::suboptimal_signatures(seq_file, params, dangles, delta, transform, verify, no_lonely_pairs);
+        pmfe::Integer total = 0;
+        for (size_t index = 0; index < classes.size(); ++index) {
+            const pmfe::ScoreSignature& signature = classes[index];
+            outfile << index << "\t" << signature.count << "\t" << signature.representative << "\t≅ " << signature.representative.score.energy.get_d() << "\n";
+            total += signature.count;
+        }
+        outfile.flush();
+
+        std::cout << "Found " << total << " suboptimal structures with " << classes.size() << " distinct score vectors." << std::endl;
+        return 0;
+    }
+
+    if (shapes) {
+        // Write the best structure of each shape after the shape itself
+        outfile << "#\tShape\t" << seq << "\tM\tU\tB\tw\tEnergy" << std::endl << std::endl;
+
+        size_t count = 0;
+        pmfe::visit_shape_structures(seq_file, params, dangles, delta, [&outfile, &count](const pmfe::RNAStructureWithScore& structure) {
+                outfile << count << "\t" << structure.shape() << "\t" << structure << "\t≅ " << structure.score.energy.get_d() << "\n";
+                ++count;
+            }, transform, verify, no_lonely_pairs);
+        outfile.flush();
+
+        std::cout << "Found " << count << " abstract shapes." << std::endl;
+        return 0;
+    }
+
     outfile << "#\t" << seq << "\tM\tU\tB\tw\tEnergy" << std::endl << std::endl;
 
-    for (unsigned int i = 0; i < structures.size(); ++i) {
-        outfile << i << "\t" << structures[i] << "\t≅ " << structures[i].score.energy.get_d() << std::endl;
+    // Get results
+    // Sorting needs every structure at once; the best-first search and the plain enumeration write each one out as soon as it is found
+    size_t count = 0;
+    auto write_structure = [&outfile, &count](const pmfe::RNAStructureWithScore& structure) {
+        outfile << count << "\t" << structure << "\t≅ " << structure.score.energy.get_d() << "\n";
+        ++count;
+    };
+
+    if (vm.count("top-k")) {
+        pmfe::visit_best_suboptimal_structures(seq_file, params, dangles, delta, vm["top-k"].as<std::size_t>(), write_structure, transform, verify, no_lonely_pairs);
+    } else if (sorted) {
+        std::vector<pmfe::RNAStructureWithScore> structures = suboptimal_structures(seq_file, params, dangles, delta, sorted, transform, verify, no_lonely_pairs);
+        std::for_each(structures.begin(), structures.end(), write_structure);
+    } else {
+        pmfe::visit_suboptimal_structures(seq_file, params, dangles, delta, write_structure, transform, verify, no_lonely_pairs);
     }
+    outfile.flush();
+
+    // Print some status information
+    std::cout << "Found " << count << " suboptimal structures." << std::endl;
 }
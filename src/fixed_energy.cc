@@ -0,0 +1,63 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar
+
+#include <stdexcept>
+#include <iostream>
+
+#include <gmpxx.h>
+
+#include "fixed_energy.h"
+#include "rational.h"
+
+namespace pmfe {
+    std::ostream& operator<<(std::ostream& os, const FixedEnergy& energy) {
+        if (energy.isFinite()) {
+            os << energy.m_units;
+        } else {
+            os << "∞";
+        }
+
+        return os;
+    }
+
+    Rational to_rational(const Rational& energy, const Integer& scale) {
+        return energy;
+    }
+
+    Rational to_rational(const FixedEnergy& energy, const Integer& scale) {
+        if (not energy.isFinite()) {
+            return Rational::infinity();
+        }
+
+        Rational result(Integer(static_cast<long>(energy.units())), scale);
+        result.canonicalize();
+        return result;
+    }
+
+    void from_rational(const Rational& value, const Integer& scale, Rational& result) {
+        result = value;
+    }
+
+    void from_rational(const Rational& value, const Integer& scale, FixedEnergy& result) {
+        if (not value.isFinite()) {
+            result = FixedEnergy::infinity();
+            return;
+        } else if (value == 0) {
+            result = FixedEnergy(0);
+            return;
+        }
+
+        mpq_class scaled = mpq_class(value) * scale;
+        scaled.canonicalize();
+
+        if (scaled.get_den() != 1) {
+            throw std::logic_error("Energy is not an exact multiple of the fixed-point scale.");
+        }
+
+        const long limit = FixedEnergy::MAX_FINITE;
+        if (abs(scaled.get_num()) > limit) {
+            throw std::overflow_error("Energy is too large for fixed-point representation.");
+        }
+
+        result = FixedEnergy(scaled.get_num().get_si());
+    }
+}
@@ -48,22 +48,33 @@ namespace pmfe {
         return mfe(seq_file, params, dangles);
     }
 
-    RNAStructureWithScore mfe(fs::path seq_file, ParameterVector params, dangle_mode dangles) {
+    namespace {
+        template <typename E>
+        RNAStructureWithScore mfe_structure(const BasicNNDBConstants<E>& constants, const RNASequence& seq, dangle_mode dangles, bool no_lonely_pairs) {
+            // Compute the minimum free energy
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+
+            // Find the associated structure
+            return energy_model.mfe_structure(seq_annotated);
+        }
+    }
+
+    RNAStructureWithScore mfe(fs::path seq_file, ParameterVector params, dangle_mode dangles, bool no_lonely_pairs) {
         // Read in thermodynamic parameters.
         Turner99 constants(params);
 
         // Read in the sequence
         RNASequence seq (seq_file);
 
-        // Compute the minimum free energy
-        NNTM energy_model(constants, dangles);
-
-        RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
-
-        Rational energy = energy_model.minimum_energy(seq_annotated);
-
-        // Find the associated structure
-        RNAStructureWithScore scored_structure = energy_model.mfe_structure(seq_annotated);
-        return scored_structure;
+        // Run the dynamic programming in fixed point whenever that is exact
+        Integer scale = fixed_point_scale(constants, seq.len());
+        if (scale != 0) {
+            FixedNNDBConstants fixed_constants(constants, scale);
+            return mfe_structure(fixed_constants, seq, dangles, no_lonely_pairs);
+        } else {
+            return mfe_structure(constants, seq, dangles, no_lonely_pairs);
+        }
     }
 }
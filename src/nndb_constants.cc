@@ -24,6 +24,11 @@
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include "nndb_constants.h"
 #include "pmfe_types.h"
@@ -48,8 +53,133 @@ namespace pmfe
 
     std::vector< RNA_base > bases_in_order = {BASE_A, BASE_C, BASE_G, BASE_U};
 
+    namespace {
+        template <typename E, std::size_t N>
+        void convert_array(const boost::multi_array<Rational, N>& source, boost::multi_array<E, N>& target, const Integer& scale) {
+            for (std::size_t k = 0; k < source.num_elements(); ++k) {
+                from_rational(source.data()[k], scale, target.data()[k]);
+            }
+        }
+
+        template <typename E>
+        void convert_vector(const std::vector<Rational>& source, std::vector<E>& target, const Integer& scale) {
+            for (std::size_t k = 0; k < source.size(); ++k) {
+                from_rational(source[k], scale, target[k]);
+            }
+        }
+
+        template <typename C, typename F>
+        void for_each_energy(C& constants, F visit) {
+            // Apply visit to every energy value stored in constants
+            for (auto value: {&constants.maxpen, &constants.auend, &constants.gubonus, &constants.cint, &constants.cslope, &constants.c3}) visit(*value);
+            for (auto table: {&constants.poppen, &constants.multConst, &constants.inter, &constants.bulge, &constants.hairpin})
+                for (auto& value: *table) visit(value);
+            for (auto& entry: constants.tloop) visit(entry.second);
+            for (auto table: {&constants.tstkh, &constants.tstki, &constants.stack, &constants.dangle})
+                std::for_each(table->data(), table->data() + table->num_elements(), visit);
+            std::for_each(constants.iloop22.data(), constants.iloop22.data() + constants.iloop22.num_elements(), visit);
+            std::for_each(constants.iloop21.data(), constants.iloop21.data() + constants.iloop21.num_elements(), visit);
+            std::for_each(constants.iloop11.data(), constants.iloop11.data() + constants.iloop11.num_elements(), visit);
+        }
+
+        std::mutex turner99_cache_mutex;
+        std::map<fs::path, std::unique_ptr<const NNDBConstants> > turner99_cache;
+    }
+
+    template <typename E>
+    BasicNNDBConstants<E>::BasicNNDBConstants(const NNDBConstants& source, const Integer& scale):
+        BasicNNDBConstants(source.params)
+    {
+        this->scale = scale;
+        gail = source.gail;
+        prelog = source.prelog;
+
+        from_rational(source.maxpen, scale, maxpen);
+        from_rational(source.auend, scale, auend);
+        from_rational(source.gubonus, scale, gubonus);
+        from_rational(source.cint, scale, cint);
+        from_rational(source.cslope, scale, cslope);
+        from_rational(source.c3, scale, c3);
+
+        convert_vector(source.poppen, poppen, scale);
+        convert_vector(source.multConst, multConst, scale);
+        convert_vector(source.inter, inter, scale);
+        convert_vector(source.bulge, bulge, scale);
+        convert_vector(source.hairpin, hairpin, scale);
+
+        for (const auto& entry: source.tloop) {
+            from_rational(entry.second, scale, tloop[entry.first]);
+        }
+
+        convert_array(source.tstkh, tstkh, scale);
+        convert_array(source.tstki, tstki, scale);
+        convert_array(source.stack, stack, scale);
+        convert_array(source.dangle, dangle, scale);
+        convert_array(source.iloop22, iloop22, scale);
+        convert_array(source.iloop21, iloop21, scale);
+        convert_array(source.iloop11, iloop11, scale);
+    }
+
+    template class BasicNNDBConstants<Rational>;
+    template class BasicNNDBConstants<FixedEnergy>;
+
+    Integer fixed_point_scale(const NNDBConstants& constants, int length, const Rational& extra) {
+        // The long-loop correction is an integer multiple of dummy_scaling / 100
+        Rational ell_unit = constants.params.dummy_scaling / 100;
+        ell_unit.canonicalize();
+
+        Integer scale = 1;
+        mpq_class largest = 0;
+        auto visit = [&scale, &largest](const Rational& value) {
+            // Most table entries are 0 or ∞, which need no GMP work
+            if (value.isFinite() and value != 0) {
+                mpq_class q = value;
+                q.canonicalize();
+                mpz_lcm(scale.get_mpz_t(), scale.get_mpz_t(), q.get_den_mpz_t());
+                if (abs(q) > largest) largest = abs(q);
+            }
+        };
+
+        for_each_energy(constants, visit);
+        visit(ell_unit);
+        visit(extra);
+
+        // Bound the long-loop correction for loops as long as the sequence
+        double ell_bound = std::abs(constants.prelog.get_d()) * (1 + std::log(std::max(length, 30) / 30.0)) + 1;
+        if (ell_bound > largest.get_d()) largest = ell_bound;
+
+        // Every structure energy is a sum of at most a few terms per base, each bounded by a constant
+        // or a per-base penalty times a length, so this is a safe bound on any finite energy
+        mpq_class bound = largest * scale * 8 * (length + 1) * (length + 1);
+        const long limit = FixedEnergy::MAX_FINITE;
+        if (bound > limit) {
+            return 0;
+        }
+
+        return scale;
+    }
+
     Turner99::Turner99(const ParameterVector& params, const fs::path& paramDir):
-        NNDBConstants(params)
+        NNDBConstants(unscaled_constants(paramDir))
+    {
+        this->params = params;
+
+        // Every parsed energy is proportional to dummy_scaling
+        if (params.dummy_scaling != 1) {
+            const Rational& factor = params.dummy_scaling;
+            for_each_energy(*this, [&factor](Rational& value) {
+                    if (value.isFinite()) value *= factor;
+                });
+            prelog *= factor;
+        }
+
+        multConst[0] = params.multiloop_penalty;
+        multConst[1] = params.unpaired_penalty;
+        multConst[2] = params.branch_penalty;
+    }
+
+    Turner99::Turner99(unscaled_tag, const fs::path& paramDir):
+        NNDBConstants(ParameterVector(multiloop_default, unpaired_default, branch_default, 1))
     {
         initMiscValues(paramDir);
 
@@ -67,6 +197,17 @@ namespace pmfe
         initIloop22Values(paramDir);
     }
 
+    const NNDBConstants& Turner99::unscaled_constants(const fs::path& paramDir) {
+        std::lock_guard<std::mutex> lock(turner99_cache_mutex);
+
+        std::unique_ptr<const NNDBConstants>& entry = turner99_cache[paramDir];
+        if (not entry) {
+            entry.reset(new Turner99(unscaled_tag(), paramDir));
+        }
+
+        return *entry;
+    }
+
     void Turner99::initMiscValues(const fs::path& paramDir) {
         // Miscellaneous parameters
         fs::ifstream fileStream;
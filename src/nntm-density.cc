@@ -0,0 +1,172 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar.
+
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "nntm.h"
+#include "pmfe_types.h"
+#include "rational.h"
+
+namespace pmfe {
+    namespace {
+        template <typename E>
+        std::map<E, Integer> convolve(const std::map<E, Integer>& a, const std::map<E, Integer>& b, const E& limit) {
+            // Count the ways to add an energy from a to one from b, for each sum up to limit
+            std::map<E, Integer> result;
+            for (auto& x: a) {
+                for (auto& y: b) {
+                    E sum = x.first + y.first;
+                    if (sum > limit) {
+                        break;
+                    }
+                    result[sum] += x.second * y.second;
+                }
+            }
+            return result;
+        }
+    }
+
+    template <typename E>
+    EnergyHistogram BasicNNTM<E>::count_suboptimal_structures(RNASequenceWithTables& seq, Rational delta) const {
+        /*
+          Count the structures within delta of the MFE by energy, without building any of them
+
+          Each structure found by visit_suboptimal_structures is reached by exactly one sequence of choices
+          in the subopt traceback, so the structures of a segment are counted by convolving the counts for
+          the segments each choice leaves. No segment of a structure can exceed its own minimum by more than
+          the whole structure exceeds the MFE, so every count only has to reach delta above its minimum.
+        */
+        // Ensure tables are available
+        if (not seq.subopt_tables_populated) {
+            populate_subopt_tables(seq);
+        }
+
+        E mfe = minimum_energy(seq);
+        DensityCache cache;
+        const Density& density = subopt_density(Segment(0, seq.len()-1, lW, mfe), seq, from_rational(delta), cache);
+
+        EnergyHistogram result;
+        for (auto& level: density) {
+            result[to_rational(mfe + level.first)] = level.second;
+        }
+        return result;
+    }
+
+    template <typename E>
+    Rational BasicNNTM<E>::delta_for_count(RNASequenceWithTables& seq, const Integer& count) const {
+        /*
+          Widen delta until the structures within it outnumber count, then read the answer off the last histogram:
+          every delta up to the energy of the first level that brings the total above count is acceptable
+
+          A histogram is truncated at its delta and cannot be extended to a wider one, so each step counts afresh,
+          and the last step dominates the cost because the number of structures grows exponentially with delta.
+          Rather than doubling, each step extrapolates that growth from the last two counts and adds one unit
+          of margin, so it usually lands just past the answer; it never more than doubles delta.
+        */
+        // Build the tables once for all the steps
+        if (not seq.subopt_tables_populated) {
+            populate_subopt_tables(seq);
+        }
+        Rational mfe = to_rational(minimum_energy(seq));
+
+        EnergyHistogram histogram;
+        Integer delta = 1;
+        Integer last_delta = 0;
+        Integer last_total = 0;
+        while (true) {
+            histogram = count_suboptimal_structures(seq, Rational(delta));
+
+            Integer total = 0;
+            for (auto& level: histogram) {
+                total += level.second;
+            }
+
+            if (total > count or delta >= MAX_COUNTED_DELTA) {
+                break;
+            }
+
+            // Deltas stay integral, so they are exact in every energy model
+            Integer next_delta = 2 * delta;
+            if (last_total > 0 and total > last_total) {
+                double growth = std::log(total.get_d() / last_total.get_d()) / Integer(delta - last_delta).get_d();
+                double steps = std::ceil(std::log(count.get_d() / total.get_d()) / growth) + 1;
+                if (steps < delta.get_d()) {
+                    next_delta = delta + static_cast<long>(steps);
+                }
+            }
+
+            last_delta = delta;
+            last_total = total;
+            delta = next_delta;
+        }
+
+        if (histogram.begin()->second > count) {
+            std::stringstream error_message;
+            error_message << histogram.begin()->second << " structures have the minimum energy, more than the requested " << count << ".";
+            throw std::invalid_argument(error_message.str());
+        }
+
+        Rational result = 0;
+        Integer total = 0;
+        for (auto& level: histogram) {
+            total += level.second;
+            if (total > count) {
+                break;
+            }
+            result = level.first - mfe;
+        }
+
+        result.canonicalize();
+        return result;
+    }
+
+    template <typename E>
+    const typename BasicNNTM<E>::Density& BasicNNTM<E>::subopt_density(const Segment& seg, const RNASequenceWithTables& seq, E delta, DensityCache& cache) const {
+        long key = (static_cast<long>(seg.label) * seq.len() + seg.i) * seq.len() + seg.j;
+        auto cached = cache.densities.find(key);
+        if (cached != cache.densities.end()) {
+            return cached->second;
+        }
+
+        /*
+          Let the subopt traceback expand a structure holding only this segment, with delta to spare.
+          The known energy of each refinement it pushes is the energy fixed by that choice
+          plus the minima of the segments it leaves.
+        */
+        RNAPartialStructure ps(seq, cache.arena);
+        ps.push(seg);
+        PartialStructureStack choices;
+
+        Density density;
+        if (not subopt_process_top_structure(seq, ps, choices, seg.minimum_energy + delta)) {
+            // The segment is too short to hold any pairs
+            density[E(0)] = 1;
+        }
+
+        while (not choices.empty()) {
+            RNAPartialStructure choice = std::move(choices.top());
+            choices.pop();
+
+            Density counts;
+            counts[choice.total() - seg.minimum_energy] = 1;
+            while (not choice.empty()) {
+                const Density& part = subopt_density(choice.top(), seq, delta, cache);
+                choice.pop();
+                counts = convolve(counts, part, delta);
+            }
+
+            for (auto& level: counts) {
+                density[level.first] += level.second;
+            }
+        }
+
+        return cache.densities[key] = std::move(density);
+    }
+
+    template class BasicNNTM<Rational>;
+    template class BasicNNTM<FixedEnergy>;
+}
@@ -6,10 +6,14 @@
 #include <assert.h>
 #include <omp.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "nntm.h"
 #include "nndb_constants.h"
 #include "rational.h"
 #include "minbox.h"
+#include "wavefront.h"
 
 #include <boost/bind.hpp>
 
@@ -19,54 +23,118 @@
 #include <boost/log/expressions.hpp>
 
 namespace pmfe {
-    NNTM::NNTM(const NNDBConstants& constants, dangle_mode dangles):
+    namespace {
+        int tetraloop_key(int i, const RNASequence& seq) {
+            /*
+              Encode the six bases of the tetraloop closed by (i, i+5) as an integer
+            */
+            int key = 0;
+            for (int k = i; k <= i + 5; ++k) {
+                key = 4 * key + seq.base(k);
+            }
+            return key;
+        }
+    }
+
+    template <typename E>
+    BasicNNTM<E>::BasicNNTM(const NNDBConstants& constants, dangle_mode dangles, bool no_lonely_pairs):
         constants(constants),
-        dangles(dangles)
-    {};
+        dangles(dangles),
+        no_lonely_pairs(no_lonely_pairs),
+        long_loop_energies(LONG_LOOP_TABLE_SIZE),
+        loop_energies(PAIR_TYPES * PAIR_TYPES * (MAXLOOP + 1) * (MAXLOOP + 1)),
+        tetraloop_energies(1 << 12, E(0))
+    {
+        for (int size = 1; size < LONG_LOOP_TABLE_SIZE; ++size) {
+            long_loop_energies[size] = calcLongLoop(size);
+        }
+
+        // Tabulate the loop energies of every pair of canonical closing pairs, in RNA_pair order
+        const int bases[PAIR_TYPES][2] = {
+            {BASE_A, BASE_U}, {BASE_C, BASE_G}, {BASE_G, BASE_C}, {BASE_G, BASE_U}, {BASE_U, BASE_A}, {BASE_U, BASE_G}
+        };
+
+        for (int outer = 0; outer < PAIR_TYPES; ++outer) {
+            for (int inner = 0; inner < PAIR_TYPES; ++inner) {
+                assert(base_pair_type(bases[outer][0], bases[outer][1]) == outer);
+                for (int size1 = 0; size1 <= MAXLOOP; ++size1) {
+                    for (int size2 = 0; size1 + size2 <= MAXLOOP; ++size2) {
+                        loop_energies[((outer * PAIR_TYPES + inner) * (MAXLOOP + 1) + size1) * (MAXLOOP + 1) + size2] =
+                            loopGeometryEnergy(bases[outer][0], bases[outer][1], bases[inner][0], bases[inner][1], size1, size2);
+                    }
+                }
+            }
+        }
 
-    RNASequenceWithTables NNTM::energy_tables(const RNASequence& inseq) const {
+        // Only keys made of the capitalized bases can match a (preprocessed) sequence
+        for (const auto& entry: constants.tloop) {
+            if (entry.first.length() == 6 and entry.first.find_first_not_of("ACGU") == std::string::npos) {
+                tetraloop_energies[tetraloop_key(0, RNASequence(entry.first))] = entry.second;
+            }
+        }
+    };
+
+    template <typename E>
+    Rational BasicNNTM<E>::to_rational(const E& energy) const {
+        return pmfe::to_rational(energy, constants.scale);
+    }
+
+    template <typename E>
+    E BasicNNTM<E>::from_rational(const Rational& value) const {
+        E result;
+        pmfe::from_rational(value, constants.scale, result);
+        return result;
+    }
+
+    template <typename E>
+    BasicRNASequenceWithTables<E> BasicNNTM<E>::energy_tables(const RNASequence& inseq) const {
         RNASequenceWithTables seq(inseq);
         populate_energy_tables(seq);
         return seq;
     };
 
-    void NNTM::populate_energy_tables(RNASequenceWithTables& seq) const {
+    template <typename E>
+    void BasicNNTM<E>::populate_energy_tables(RNASequenceWithTables& seq) const {
         /*
           Construct the energy tables for the DP algorithm
         */
         // Input specification
         assert(not seq.energy_tables_populated);
 
-        // Populate V, VM, VBI, WM, and WMPrime
-        for (int b = TURN+1; b <= seq.len() - 1; ++b) {
-#pragma omp parallel for shared(seq)
-            for (int i = 0; i <= seq.len() - 1 - b; ++i) {
-                populate_energy_tables(i, i+b, seq);
-            }
+        // VP is only read when lonely pairs are excluded, so it is allocated on demand
+        if (no_lonely_pairs and seq.VP.size() != seq.len()) {
+            seq.VP = TriangularTable<E>(seq.len(), E::infinity());
         }
 
+        // Populate V, VM, VBI, WM, and WMPrime
+        // Cells with the same i+j share a row of generic internal loop minima (see extendGenericLoops)
+        std::vector<E> generic_loops(std::max(2 * seq.len() - 1, 0) * GENERIC_LOOP_SIZES, E::infinity());
+        tiled_wavefront(seq.len(), TURN+1, [this, &seq, &generic_loops](int i, int j) {
+                populate_energy_tables(i, j, seq, &generic_loops[(i + j) * GENERIC_LOOP_SIZES]);
+            });
+
         // Populate W
         for (int j = 0; j <= seq.len() - 1; ++j) {
             if (j <= TURN) {
-                seq.W[j] = 0;
+                seq.W[j] = E(0);
                 continue;
             }
 
-            MinBox<Rational> w_vals;
-            w_vals.insert(Rational::infinity());
+            MinBox<E> w_vals;
+            w_vals.insert(E::infinity());
 
             for (int i = 0; i < j-TURN; i++) {
-                Rational Wim1;
+                E Wim1;
                 if (i > 0) {
                     Wim1 = seq.W[i-1];
                 } else {
-                    Wim1 = 0;
+                    Wim1 = E(0);
                 }
 
                 switch (dangles) {
                 case BOTH_DANGLE:
                     {
-                        Rational Widjd = seq.V[i][j] + auPenalty(i, j, seq) + Wim1;
+                        E Widjd = seq.V[i][j] + auPenalty(i, j, seq) + Wim1;
                         if (i > 0) {
                             Widjd += Ed5(i, j, seq);
                         }
@@ -101,7 +169,7 @@ namespace pmfe {
             }
 
             w_vals.insert(seq.W[j-1]); // Base j is free
-            w_vals.insert(0); // All bases up to j are free
+            w_vals.insert(E(0)); // All bases up to j are free
 
             seq.W[j] = w_vals.minimum();
         }
@@ -109,17 +177,20 @@ namespace pmfe {
         seq.energy_tables_populated = true;
     }
 
-    void NNTM::populate_energy_tables(int i, int j, RNASequenceWithTables& seq) const {
+    template <typename E>
+    void BasicNNTM<E>::populate_energy_tables(int i, int j, RNASequenceWithTables& seq, E* generic_loops) const {
         // Input specification
         assert (0 <= i);
         assert (j < seq.len());
         assert (i < j);
 
+        extendGenericLoops(i, j, seq, generic_loops);
+
         if (seq.can_pair(i, j)) {
-            MinBox<Rational> vm_vals;
-            vm_vals.insert(Rational::infinity());
+            MinBox<E> vm_vals;
+            vm_vals.insert(E::infinity());
 
-            Rational d3, d5;
+            E d3, d5;
             d3 = Ed3(i, j, seq, true);
             d5 = Ed5(i, j, seq, true);
 
@@ -152,23 +223,33 @@ namespace pmfe {
 
             seq.VM[i][j] = vm_vals.minimum();
 
-            MinBox<Rational> v_vals;
-            v_vals.insert(Rational::infinity());
+            MinBox<E> v_vals;
+            v_vals.insert(E::infinity());
             v_vals.insert(seq.VM[i][j]);
 
             v_vals.insert(eH(i, j, seq));
-            v_vals.insert(eS(i, j, seq) + seq.V[i+1][j-1]);
 
-            seq.VBI[i][j] = calcVBI(i, j, seq);
+            seq.VBI[i][j] = calcVBI(i, j, seq, generic_loops);
             v_vals.insert(seq.VBI[i][j]);
 
-            seq.V[i][j] = v_vals.minimum();
+            if (no_lonely_pairs) {
+                /*
+                  A pair closing any loop but a stack is only allowed if it stacks on (i-1, j+1), which VP assumes.
+                  Every other loop encloses (i, j) through V, so there it must stack on (i+1, j-1).
+                */
+                v_vals.insert(eS(i, j, seq) + seq.VP[i+1][j-1]);
+                seq.VP[i][j] = v_vals.minimum();
+                seq.V[i][j] = eS(i, j, seq) + seq.VP[i+1][j-1];
+            } else {
+                v_vals.insert(eS(i, j, seq) + seq.V[i+1][j-1]);
+                seq.V[i][j] = v_vals.minimum();
+            }
         } else {
-            seq.V[i][j] = Rational::infinity();
+            seq.V[i][j] = E::infinity();
         }
 
-        MinBox<Rational> wmp_vals;
-        wmp_vals.insert(Rational::infinity());
+        MinBox<E> wmp_vals;
+        wmp_vals.insert(E::infinity());
 
         for (int h = i+TURN+1 ; h <= j-TURN-2; ++h) {
             wmp_vals.insert(seq.WM[i][h] + seq.WM[h+1][j]);
@@ -177,14 +258,14 @@ namespace pmfe {
         seq.WMPrime[i][j] = wmp_vals.minimum();
 
         // WM begin
-        MinBox<Rational> wm_vals;
-        wm_vals.insert(Rational::infinity());
+        MinBox<E> wm_vals;
+        wm_vals.insert(E::infinity());
         wm_vals.insert(seq.WMPrime[i][j]);
 
         switch (dangles) {
         case BOTH_DANGLE:
             {
-                Rational energy = seq.V[i][j] + auPenalty(i, j, seq) + constants.multConst[2];
+                E energy = seq.V[i][j] + auPenalty(i, j, seq) + constants.multConst[2];
 
                 if (i > 0) {
                     energy += Ed5(i, j, seq);
@@ -229,7 +310,8 @@ namespace pmfe {
         // WM end
     }
 
-    Rational NNTM::minimum_energy(RNASequenceWithTables& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::minimum_energy(RNASequenceWithTables& seq) const {
         /*
           Return the minimum energy of a structure on this sequence
         */
@@ -243,12 +325,13 @@ namespace pmfe {
 
     // dangle on the 5' end of (i, j)
     // if inside==true, dangle i+1 instead of i-1
-    Rational NNTM::Ed5(int i, int j, const RNASequence& seq, bool inside) const {
+    template <typename E>
+    E BasicNNTM<E>::Ed5(int i, int j, const RNASequence& seq, bool inside) const {
         // Input specification
         assert (i >= 0 and i < seq.len());
         assert (j >= 0 and j < seq.len());
 
-        Rational penalty = 0;
+        E penalty = E(0);
 
         if (i > 0) {
             if (inside)
@@ -267,12 +350,13 @@ namespace pmfe {
 
     // dangle on the 3' end of (i, j)
     // if inside==true, dangle j-1 instead of j+1
-    Rational NNTM::Ed3(int i, int j, const RNASequence& seq, bool inside) const {
+    template <typename E>
+    E BasicNNTM<E>::Ed3(int i, int j, const RNASequence& seq, bool inside) const {
         // Input specification
         assert (i >= 0 and i < seq.len());
         assert (j >= 0 and j < seq.len());
 
-        Rational penalty = 0;
+        E penalty = E(0);
 
         if (j < seq.len()-1) {
             if (inside)
@@ -289,23 +373,45 @@ namespace pmfe {
         return penalty;
     }
 
-    Rational NNTM::auPenalty(int i, int j, const RNASequence& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::auPenalty(int i, int j, const RNASequence& seq) const {
         /*
           Return the pairing penalty for (i, j); this is nonzero unless it is a GC pair
         */
-        int base_i = seq.base(i);
-        int base_j = seq.base(j);
+        return pairPenalty(seq.base(i), seq.base(j));
+    }
+
+    template <typename E>
+    E BasicNNTM<E>::pairPenalty(int base_i, int base_j) const {
+        /*
+          Return the pairing penalty for a pair of the given bases
+        */
         if (
             (base_i == BASE_U and (base_j == BASE_A or base_j == BASE_G)) or
             (base_j == BASE_U and (base_i == BASE_A or base_i == BASE_G))
             ) {
             return constants.auend;
         } else {
-            return 0;
+            return E(0);
+        }
+    }
+
+    template <typename E>
+    E BasicNNTM<E>::eLL(int size) const {
+        /*
+          Return the energy correction for a long loop
+        */
+        assert(size > 0);
+
+        if (size < LONG_LOOP_TABLE_SIZE) {
+            return long_loop_energies[size];
+        } else {
+            return calcLongLoop(size);
         }
     }
 
-    Rational NNTM::eLL(int size) const {
+    template <typename E>
+    E BasicNNTM<E>::calcLongLoop(int size) const {
         /*
           Compute the energy correction for a long loop
         */
@@ -313,16 +419,53 @@ namespace pmfe {
         // To match the GTMFE algorithm, we force this to have two decimal digits of precision
         // TODO: Clean this up by interfacing with fancified NNDB
         if (constants.params.dummy_scaling == 0) {
-            return 0;
+            return E(0);
         } else {
             Rational prelog = constants.prelog / constants.params.dummy_scaling;
             Rational result = (Integer) (100 * prelog.get_d() * log((double) size / 30.0));
             result *= Rational(constants.params.dummy_scaling / 100);
-            return result;
+            return from_rational(result);
         }
     }
 
-    Rational NNTM::eL(int i, int j, int ip, int jp, const RNASequence& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::loopGeometryEnergy(int base_i, int base_j, int base_ip, int base_jp, int size1, int size2) const {
+        /*
+          Compute the part of the energy of an internal loop or bulge which depends only on its closing pairs and sizes
+
+          eL adds the terminal mismatches of generic internal loops; the 1x1, 1x2 and 2x2 loops are looked up
+          in their own tables, so the value here is not used for them.
+        */
+        int size = size1 + size2;
+
+        if (size1 == 0 or size2 == 0) {
+            if (size > 30) {
+                /* AM: Does not depend upon i and j and ip and jp - Stacking Energies */
+                return constants.bulge[30] + eLL(size) + pairPenalty(base_i, base_j) + pairPenalty(base_ip, base_jp);
+            } else if (size > 1) {
+                /* Does not depend upon i and j and ip and jp - Stacking Energies  */
+                return constants.bulge[size] + pairPenalty(base_i, base_j) + pairPenalty(base_ip, base_jp);
+            } else if (size == 1) {
+                return constants.stack[base_i][base_j][base_ip][base_jp] + constants.bulge[size];
+            } else {
+                // Degenerate case that this is actually a stack, included for ease of coding elsewhere
+                return constants.stack[base_i][base_j][base_ip][base_jp];
+            }
+        }
+
+        E energy = (size > 30) ? constants.inter[30] + eLL(size) : constants.inter[size];
+        energy += eNinio(abs(size1 - size2), std::min(2, std::min(size1, size2)));
+
+        if ((size1 == 1 or size2 == 1) and constants.gail) {
+            /* gail = (Grossly Asymmetric Interior Loop Rule) (on/off <-> 1/0)  */
+            energy += constants.tstki[base_i][base_j][BASE_A][BASE_A] + constants.tstki[base_jp][base_ip][BASE_A][BASE_A];
+        }
+
+        return energy;
+    }
+
+    template <typename E>
+    E BasicNNTM<E>::eL(int i, int j, int ip, int jp, const RNASequence& seq) const {
         /*
           Compute the energy of an internal loop between pairs (i, j) and (ip, jp)
         */
@@ -331,84 +474,40 @@ namespace pmfe {
         assert (j >= 0 and j < seq.len());
         assert (i < ip and ip < jp and jp < j);
 
-        Rational energy = Rational::infinity();
-
-        /*SH: These calculations used to incorrectly be within the bulge loop code, moved out here. */
         int size1 = ip - i - 1;
         int size2 = j - jp - 1;
-        int size = size1 + size2;
 
-        int lopsided = abs(size1 - size2); /* define the asymmetry of an interior loop */
+        if (size1 == 2 and size2 == 2) { /* 2x2 internal loop */
+            return constants.iloop22[seq.base(i)][seq.base(ip)][seq.base(j)][seq.base(jp)][seq.base(i+1)][seq.base(j-1)][seq.base(i+2)][seq.base(j-2)];
+        } else if (size1 == 1 and size2 == 2) {
+            return constants.iloop21[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)][seq.base(j - 2)][seq.base(ip)][seq.base(jp)];
+        } else if (size1 == 2 and size2 == 1) { /* 1x2 internal loop */
+            return constants.iloop21[seq.base(jp)][seq.base(ip)][seq.base(j - 1)][seq.base(i + 2)][seq.base(i + 1)][seq.base(j)][seq.base(i)];
+        } else if (size1 == 1 and size2 == 1) { /* 1*1 internal loops */
+            return constants.iloop11[seq.base(i)][seq.base(i + 1)][seq.base(ip)][seq.base(j)][seq.base(j - 1)][seq.base(jp)];
+        }
 
-        int pindex = std::min(2, std::min(size1, size2));
-        Rational lvalue = lopsided * constants.poppen[pindex];
-        Rational penterm;
+        int outer = seq.pair_type(i, j);
+        int inner = seq.pair_type(ip, jp);
 
-        if (constants.params.dummy_scaling >= 0) {
-            penterm = std::min(constants.maxpen, lvalue);
+        E energy;
+        if (size1 + size2 <= MAXLOOP and outer != PAIR_NONE and inner != PAIR_NONE) {
+            energy = loop_energies[((outer * PAIR_TYPES + inner) * (MAXLOOP + 1) + size1) * (MAXLOOP + 1) + size2];
         } else {
-            penterm = std::max(constants.maxpen, lvalue);
+            energy = loopGeometryEnergy(seq.base(i), seq.base(j), seq.base(ip), seq.base(jp), size1, size2);
         }
 
-        if (size1 == 0 or size2 == 0) {
-            if (size > 30) {
-                /* AM: Does not depend upon i and j and ip and jp - Stacking Energies */
-                energy = constants.bulge[30]
-                    + eLL(size)
-                    + auPenalty(i, j, seq)
-                    + auPenalty(ip, jp, seq);
-            } else if (size <= 30 and size > 1) {
-                /* Does not depend upon i and j and ip and jp - Stacking Energies  */
-                energy = constants.bulge[size]
-                    + auPenalty(i, j, seq)
-                    + auPenalty(ip, jp, seq);
-            } else if (size == 1) {
-                energy = constants.stack[seq.base(i)][seq.base(j)][seq.base(ip)][seq.base(jp)]
-                    + constants.bulge[size];
-            } else if (size == 0) {
-                // Degenerate case that this is actually a stack, included for ease of coding elsewhere
-                energy = constants.stack[seq.base(i)][seq.base(j)][seq.base(ip)][seq.base(jp)];
-            }
-        } else {
-            /* Internal loop */
-
-            if (size > 30) {
-                if (not ((size1 == 1 or size2 == 1) and constants.gail)) { /* normal internal loop with size > 30*/
-                    energy = constants.tstki[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)]
-                        + constants.tstki[seq.base(jp)][seq.base(ip)][seq.base(jp + 1)][seq.base(ip - 1)] + constants.inter[30]
-                        + eLL(size)
-                        + penterm;
-                } else { /* if size is more than 30 and it is a grossely asymmetric internal loop and gail is not 0*/
-                    energy = constants.tstki[seq.base(i)][seq.base(j)][BASE_A][BASE_A]
-                        + constants.tstki[seq.base(jp)][seq.base(ip)][BASE_A][BASE_A]
-                        + constants.inter[30]
-                        + eLL(size)
-                        + penterm;
-                }
-            } else if (size1 == 2 and size2 == 2) { /* 2x2 internal loop */
-                energy = constants.iloop22[seq.base(i)][seq.base(ip)][seq.base(j)][seq.base(jp)][seq.base(i+1)][seq.base(j-1)][seq.base(i+2)][seq.base(j-2)];
-            } else if (size1 == 1 and size2 == 2) {
-                energy = constants.iloop21[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)][seq.base(j - 2)][seq.base(ip)][seq.base(jp)];
-            } else if (size1 == 2 and size2 == 1) { /* 1x2 internal loop */
-                energy = constants.iloop21[seq.base(jp)][seq.base(ip)][seq.base(j - 1)][seq.base(i + 2)][seq.base(i + 1)][seq.base(j)][seq.base(i)];
-            } else if (size == 2) { /* 1*1 internal loops */
-                energy = constants.iloop11[seq.base(i)][seq.base(i + 1)][seq.base(ip)][seq.base(j)][seq.base(j - 1)][seq.base(jp)];
-            } else if ((size1 == 1 or size2 == 1) and constants.gail) { /* gail = (Grossly Asymmetric Interior Loop Rule) (on/off <-> 1/0)  */
-                energy = constants.tstki[seq.base(i)][seq.base(j)][BASE_A][BASE_A] + constants.tstki[seq.base(jp)][seq.base(ip)][BASE_A][BASE_A]
-                    + constants.inter[size]
-                    + penterm;
-            } else { /* General Internal loops */
-                energy = constants.tstki[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)]
-                    + constants.tstki[seq.base(jp)][seq.base(ip)][seq.base(jp + 1)][seq.base(ip - 1)]
-                    + constants.inter[size]
-                    + penterm;
-            }
+        if (size1 > 0 and size2 > 0 and not ((size1 == 1 or size2 == 1) and constants.gail)) {
+            /* General internal loops also depend on the terminal mismatches */
+            energy += constants.tstki[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)]
+                + constants.tstki[seq.base(jp)][seq.base(ip)][seq.base(jp + 1)][seq.base(ip - 1)];
         }
 
         return energy;
     }
 
-    Rational NNTM::eH(int i, int j, const RNASequence& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::eH(int i, int j, const RNASequence& seq) const {
         /*
           Compute the energy of a hairpin loop based at pair (i, j)
         */
@@ -418,7 +517,7 @@ namespace pmfe {
         assert (j >= 0 and j < seq.len());
         assert (i < j);
 
-        Rational energy = Rational::infinity();
+        E energy = E::infinity();
 
         int size = j - i - 1; /*  size is the number of bases in the loop, when the closing pair is excluded */
 
@@ -433,11 +532,7 @@ namespace pmfe {
         }
 
         else if (size == 4) {
-            std::string loopkey = seq.subsequence(i, j);
-            Rational tlink = 0; // Loop contribution is typically 0
-            if (constants.tloop.count(loopkey) != 0) {
-                tlink = constants.tloop.find(loopkey)->second; // But some loops have special contributions, stored in this table
-            }
+            E tlink = tetraloop_energies[tetraloop_key(i, seq)]; // Loop contribution is typically 0, but some loops have special contributions
             energy = tlink + constants.hairpin[size] + constants.tstkh[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)];
         }
 
@@ -456,7 +551,7 @@ namespace pmfe {
             /*  no terminal mismatch */
             energy = constants.hairpin[size];
         } else if (size == 0)
-            energy = Rational::infinity();
+            energy = E::infinity();
 
         /*  GGG Bonus => GU closure preceded by GG */
         /*  i-2 = i-1 = i = G, and j = U; i < j */
@@ -469,13 +564,7 @@ namespace pmfe {
         }
 
         /*  Poly-C loop => How many C are needed for being a poly-C loop */
-        Rational tlink = 1;
-        for (int index = 1; (index <= size) and (tlink == 1); ++index) {
-            if (seq.base(i + index) != BASE_C)
-                tlink = 0;
-        }
-
-        if (tlink == 1) {
+        if (seq.poly_c(i, j)) {
             if (size == 3) {
                 energy += constants.c3;
             } else {
@@ -486,7 +575,8 @@ namespace pmfe {
         return energy;
     }
 
-    Rational NNTM::eS(int i, int j, const RNASequence& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::eS(int i, int j, const RNASequence& seq) const {
         /*
           Compute the energy of a stack of pairs (i, j) and (i+1, j-1)
         */
@@ -498,9 +588,68 @@ namespace pmfe {
         return constants.stack[seq.base(i)][seq.base(j)][seq.base(i+1)][seq.base(j-1)];
     }
 
-    Rational NNTM::calcVBI(int i, int j, const RNASequenceWithTables& seq) const {
+    template <typename E>
+    E BasicNNTM<E>::eNinio(int lopsided, int pindex) const {
+        /*
+          Compute the asymmetry penalty of an internal loop
+        */
+        E lvalue = lopsided * constants.poppen[pindex];
+
+        if (constants.params.dummy_scaling >= 0) {
+            return std::min(constants.maxpen, lvalue);
+        } else {
+            return std::max(constants.maxpen, lvalue);
+        }
+    }
+
+    template <typename E>
+    void BasicNNTM<E>::extendGenericLoops(int i, int j, const RNASequenceWithTables& seq, E* generic_loops) const {
+        /*
+          Maintain the generic internal loop minima for Lyngsø's O(n^2 MAXLOOP) internal loop recursion
+
+          A generic internal loop has at least two unpaired bases on each side and total size at least 5,
+          so its energy is tstki(outer pair) + tstki(inner pair) + a term depending only on the size + a Ninio term
+          depending only on the asymmetry. On entry generic_loops[l-4] holds, for (i+1, j-1),
+            min over inner pairs (p, q) closing a loop of size l with two or more bases on each side
+            of V[p][q] + tstki(inner pair) + eNinio,
+          and on exit it holds the same for (i, j). Shrinking a loop by one base on each side keeps its inner pair
+          and its asymmetry, so only the loops with exactly two bases on one side are new.
+          Size 4 (the 2x2 loops, which have their own table) is only kept to seed the symmetric loops of size 6.
+        */
+
+        for (int l = MAXLOOP; l >= 4; --l) {
+            MinBox<E> vals;
+            vals.insert(E::infinity());
+
+            if (l >= 6) {
+                vals.insert(generic_loops[l - 6]);
+            }
+
+            // Two bases on the 5' side
+            int p = i + 3;
+            int q = j - l + 1;
+            if (q - p > TURN) {
+                vals.insert(seq.V[p][q] + constants.tstki[seq.base(q)][seq.base(p)][seq.base(q + 1)][seq.base(p - 1)] + eNinio(l - 4, 2));
+            }
+
+            // Two bases on the 3' side
+            p = i + l - 1;
+            q = j - 3;
+            if (q - p > TURN) {
+                vals.insert(seq.V[p][q] + constants.tstki[seq.base(q)][seq.base(p)][seq.base(q + 1)][seq.base(p - 1)] + eNinio(l - 4, 2));
+            }
+
+            generic_loops[l - 4] = vals.minimum();
+        }
+    }
+
+    template <typename E>
+    E BasicNNTM<E>::calcVBI(int i, int j, const RNASequenceWithTables& seq, const E* generic_loops) const {
         /*
           Helper method to populate the VBI array
+
+          Generic internal loops come from the minima maintained by extendGenericLoops, so only bulges,
+          loops with a single base on one side and 2x2 loops are enumerated here.
         */
 
         // Input specification
@@ -508,29 +657,41 @@ namespace pmfe {
         assert (j >= 0 and j < seq.len());
         assert (i < j);
 
-        MinBox<Rational> vals;
-        vals.insert(Rational::infinity());
+        MinBox<E> vals;
+        vals.insert(E::infinity());
 
-        for (int p = i+1; p <= std::min(j-2-TURN, i+MAXLOOP+1) ; ++p) {
-            int minq = j-i+p-MAXLOOP-2;
-            if (minq < p+1+TURN)
-                minq = p+1+TURN;
+        auto try_loop = [&](int size1, int size2) {
+            int p = i + size1 + 1;
+            int q = j - size2 - 1;
+            if (q - p > TURN and seq.can_pair(p, q)) {
+                vals.insert(eL(i, j, p, q, seq) + seq.V[p][q]);
+            }
+        };
 
-            int maxq;
-            if (p == i+1) {
-                maxq = j-2;
-            } else {
-                maxq = j-1;
+        for (int size1 = 0; size1 <= 1; ++size1) {
+            for (int size2 = (size1 == 0) ? 1 : 0; size1 + size2 <= MAXLOOP; ++size2) {
+                try_loop(size1, size2);
             }
+        }
 
-            for (int q = minq; q <= maxq; q++) {
-                if (q - p > TURN and seq.can_pair(p, q)) {
-                    vals.insert(eL(i, j, p, q, seq) + seq.V[p][q]);
-                }
+        for (int size2 = 0; size2 <= 1; ++size2) {
+            for (int size1 = 2; size1 + size2 <= MAXLOOP; ++size1) {
+                try_loop(size1, size2);
             }
         }
 
-        Rational VBIij = vals.minimum();
+        try_loop(2, 2);
+
+        E outer = constants.tstki[seq.base(i)][seq.base(j)][seq.base(i + 1)][seq.base(j - 1)];
+        for (int l = 5; l <= MAXLOOP; ++l) {
+            E size_energy = (l <= 30) ? constants.inter[l] : constants.inter[30] + eLL(l);
+            vals.insert(outer + size_energy + generic_loops[l - 4]);
+        }
+
+        E VBIij = vals.minimum();
         return VBIij;
     }
+
+    template class BasicNNTM<Rational>;
+    template class BasicNNTM<FixedEnergy>;
 };
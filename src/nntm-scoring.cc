@@ -16,29 +16,40 @@
 #include <boost/log/expressions.hpp>
 
 namespace pmfe {
-    ScoreVector NNTM::score(const RNAStructure& structure, bool compute_w) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::score(const RNAStructure& structure, bool compute_w) const {
         RNAStructureTree tree (structure);
 
         // Score the structure using these parameters
         ScoreVector result = scoreTree(tree);
 
-        // If requested, compute the w value by re-scoring the structure with the classical parameters
+        // If requested, compute the w value
         if (compute_w) {
-            Turner99 classical_constants;
-            NNTM classical_model(classical_constants, dangles);
-            ScoreVector classical_score = classical_model.score(structure, false);
-            Rational classical_energy = classical_score.energy;
-            result.w = classical_energy - (result.multiloops * classical_constants.multConst[0] + result.unpaired * classical_constants.multConst[1] + result.branches * classical_constants.multConst[2]);
+            const ParameterVector& params = constants.params;
+            Rational multiloop_energy = result.multiloops * params.multiloop_penalty + result.unpaired * params.unpaired_penalty + result.branches * params.branch_penalty;
 
-            // Check that the computed w is consistent
-            Rational formula_energy = result.multiloops * constants.params.multiloop_penalty + result.unpaired * constants.params.unpaired_penalty + result.branches * constants.params.branch_penalty + result.w * constants.params.dummy_scaling;
-            formula_energy.canonicalize();
-
-            if (result.energy != formula_energy) {
-                BOOST_LOG_TRIVIAL(error) << "Inconsistent w: " << result.energy.get_d() << " ≅ " << formula_energy.get_d();
-                BOOST_LOG_TRIVIAL(error) << constants.params;
-
-                throw std::logic_error("w calculation was inconsistent!");
+            if (params.dummy_scaling > 0) {
+                // Every other energy term is dummy_scaling times its classical value, so w falls out of this pass
+                result.w = (result.energy - multiloop_energy) / params.dummy_scaling;
+            } else {
+                // The scores carry no information about w (or the Ninio correction is not linear), so
+                // re-score the structure with the classical parameters, which are only loaded once
+                static const Turner99 classical_constants;
+                NNTM classical_model(classical_constants, dangles);
+                ScoreVector classical_score = classical_model.score(structure, false);
+                Rational classical_energy = classical_score.energy;
+                result.w = classical_energy - (result.multiloops * classical_constants.multConst[0] + result.unpaired * classical_constants.multConst[1] + result.branches * classical_constants.multConst[2]);
+
+                // Check that the computed w is consistent
+                Rational formula_energy = multiloop_energy + result.w * params.dummy_scaling;
+                formula_energy.canonicalize();
+
+                if (result.energy != formula_energy) {
+                    BOOST_LOG_TRIVIAL(error) << "Inconsistent w: " << result.energy.get_d() << " ≅ " << formula_energy.get_d();
+                    BOOST_LOG_TRIVIAL(error) << params;
+
+                    throw std::logic_error("w calculation was inconsistent!");
+                }
             }
         }
 
@@ -47,7 +58,8 @@ namespace pmfe {
 
     }
 
-    ScoreVector NNTM::scoreTree(const RNAStructureTree& tree) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::scoreTree(const RNAStructureTree& tree) const {
         BOOST_LOG_TRIVIAL(debug) << "Starting structure scoring.";
         // Score the external node
         ScoreVector score = scoreE(tree);
@@ -60,7 +72,8 @@ namespace pmfe {
         return score;
     }
 
-    ScoreVector NNTM::scoreInternalNodeRecursively(const RNAStructureTree& tree, const IntervalTreeNode& node) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::scoreInternalNodeRecursively(const RNAStructureTree& tree, const IntervalTreeNode& node) const {
         // TODO: Confirm that node is in tree
         ScoreVector score;
 
@@ -73,9 +86,9 @@ namespace pmfe {
         case 0:
         {
             // Hairpin loop
-            Rational loop = eH(i, j, tree.seq);
-            score.energy += loop;
-            BOOST_LOG_TRIVIAL(debug) << "Hairpin (" << i << ", " << j << ") with energy " << loop.get_d();
+            E loop = eH(i, j, tree.seq);
+            score.energy += to_rational(loop);
+            BOOST_LOG_TRIVIAL(debug) << "Hairpin (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
             break;
         }
 
@@ -86,14 +99,14 @@ namespace pmfe {
 
             if (child.start == i + 1 and child.end == j - 1) {
                 // Stack
-                Rational loop = eS(i, j, tree.seq);
-                score.energy += loop;
-                BOOST_LOG_TRIVIAL(debug) << "Stack (" << i << ", " << j << ") with energy " << loop.get_d();
+                E loop = eS(i, j, tree.seq);
+                score.energy += to_rational(loop);
+                BOOST_LOG_TRIVIAL(debug) << "Stack (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
             } else {
                 // Internal or bulge
-                Rational loop = eL(i, j, child.start, child.end, tree.seq);
-                score.energy += loop;
-                BOOST_LOG_TRIVIAL(debug) << "IntLoop (" << i << ", " << j << ") to (" << child.start << ", " << child.end << ") with energy " << loop.get_d();
+                E loop = eL(i, j, child.start, child.end, tree.seq);
+                score.energy += to_rational(loop);
+                BOOST_LOG_TRIVIAL(debug) << "IntLoop (" << i << ", " << j << ") to (" << child.start << ", " << child.end << ") with energy " << to_rational(loop).get_d();
             }
 
             break;
@@ -117,7 +130,8 @@ namespace pmfe {
         return score;
     }
 
-    ScoreVector NNTM::scoreMUnpairedRegion(const RNAStructure& structure, int i1, int j1, int i2, int j2, bool is_external) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::scoreMUnpairedRegion(const RNAStructure& structure, int i1, int j1, int i2, int j2, bool is_external) const {
         /*
           Helper method to compute the energy of an unpaired region in a multiloop which lies between pairs (i1, j1) and (i2, j2)
           Note that this requires i1 < i2 < j2 < j1 if (i1, j1) initiates the loop,
@@ -126,7 +140,7 @@ namespace pmfe {
         */
 
         int start, end;
-        Rational d5, d3;
+        E d5, d3;
 
         if (i1 < i2 and i2 < j2 and j2 < j1) {
             // (i1, j1) is the initiating pair of the loop, so
@@ -156,7 +170,7 @@ namespace pmfe {
         ScoreVector score;
 
         if (not is_external) {
-            score.energy += (end - start - 1) * constants.multConst[1]; // Unpaired base penalty
+            score.energy += to_rational((end - start - 1) * constants.multConst[1]); // Unpaired base penalty
             score.unpaired += end - start - 1;
         }
 
@@ -166,7 +180,7 @@ namespace pmfe {
         {
             // In BOTH_DANGLE mode, we just compute the dangle energies and add them
             // without any logic to determine whether this is reasonable
-            score.energy += d5 + d3;
+            score.energy += to_rational(d5 + d3);
             break;
         }
 
@@ -174,11 +188,11 @@ namespace pmfe {
         {
             // Apply dangling contributions as recorded in the structure
             if (structure.does_d5(end - 1)) {
-                score.energy += d3;
+                score.energy += to_rational(d3);
             }
 
             if (structure.does_d3(start + 1)) {
-                score.energy += d5;
+                score.energy += to_rational(d5);
             }
 
             break;
@@ -193,18 +207,19 @@ namespace pmfe {
         return score;
     }
 
-    ScoreVector NNTM::scoreM(const RNAStructureTree& tree, const IntervalTreeNode& node) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::scoreM(const RNAStructureTree& tree, const IntervalTreeNode& node) const {
         /*
            Score a multiloop
         */
 
         ScoreVector score;
         // Contribution from initializing the multiloop
-        score.energy += constants.multConst[0];
+        score.energy += to_rational(constants.multConst[0]);
         score.multiloops += 1;
 
         // Contribution from branches
-        score.energy += (node.valency() + 1) * constants.multConst[2]; // Branch penalty
+        score.energy += to_rational((node.valency() + 1) * constants.multConst[2]); // Branch penalty
         score.branches += (node.valency() + 1);
 
         // Unpaired bases are accounted in the eMUnpairedRegion helper method
@@ -223,10 +238,10 @@ namespace pmfe {
             }
 
             // We also need to account for any non-GC pairs at the branches
-            score.energy += auPenalty(node.start, node.end, tree.seq);
+            score.energy += to_rational(auPenalty(node.start, node.end, tree.seq));
 
             for (auto& child: node.children) {
-                score.energy += auPenalty(child.start, child.end, tree.seq);
+                score.energy += to_rational(auPenalty(child.start, child.end, tree.seq));
             }
         }
 
@@ -234,7 +249,8 @@ namespace pmfe {
     }
 
 
-    ScoreVector NNTM::scoreE(const RNAStructureTree& tree) const {
+    template <typename E>
+    ScoreVector BasicNNTM<E>::scoreE(const RNAStructureTree& tree) const {
         /*
           Score the external loop
         */
@@ -243,7 +259,7 @@ namespace pmfe {
         // Add the contribution for each unpaired region
         // First, consider the dangling regions at the ends of the sequence
         bool has_5d, has_3d;
-        Rational d3, d5;
+        E d3, d5;
 
         // If there are no children, stop immediately
         if (tree.root.valency() == 0) {
@@ -259,7 +275,7 @@ namespace pmfe {
             d5 = Ed5(firstbranch.start, firstbranch.end, tree.seq);
         } else {
             has_5d = false;
-            d5 = 0;
+            d5 = E(0);
         }
 
         if (lastbranch.end < tree.len() - 1) { // If there is a dangling 3' end
@@ -267,24 +283,24 @@ namespace pmfe {
             d3 = Ed3(lastbranch.start, lastbranch.end, tree.seq);
         } else {
             has_3d = false;
-            d3 = 0;
+            d3 = E(0);
         }
 
         switch (dangles) {
         case BOTH_DANGLE:
         {
-            score.energy += d3 + d5;
+            score.energy += to_rational(d3 + d5);
             break;
         }
 
         case CHOOSE_DANGLE:
         {
             if (has_5d) {
-                score.energy += d5;
+                score.energy += to_rational(d5);
             }
 
             if (has_3d) {
-                score.energy += d3;
+                score.energy += to_rational(d3);
             }
 
             break;
@@ -306,10 +322,13 @@ namespace pmfe {
 
         // We also need to account for any non-GC pairs at the branches
         for (auto& child: tree.root.children) {
-            score.energy += auPenalty(child.start, child.end, tree.seq);
+            score.energy += to_rational(auPenalty(child.start, child.end, tree.seq));
         }
 
         BOOST_LOG_TRIVIAL(debug) << "External loop energy " << score.energy.get_d();
         return score;
     }
+
+    template class BasicNNTM<Rational>;
+    template class BasicNNTM<FixedEnergy>;
 }
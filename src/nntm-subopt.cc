@@ -5,12 +5,20 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_set>
+#include <utility>
 #include <omp.h>
 
 #include "nntm.h"
 #include "nndb_constants.h"
 #include "pmfe_types.h"
 #include "rational.h"
+#include "wavefront.h"
+#include "work_stealing.h"
 
 #include "boost/multi_array.hpp"
 
@@ -20,7 +28,8 @@
 #include <boost/log/expressions.hpp>
 
 namespace pmfe {
-    void NNTM::populate_subopt_tables(RNASequenceWithTables& seq) const {
+    template <typename E>
+    void BasicNNTM<E>::populate_subopt_tables(RNASequenceWithTables& seq) const {
         /*
           Construct the helper tables for the subopt traceback algorithm
         */
@@ -28,19 +37,17 @@ namespace pmfe {
         assert(not seq.subopt_tables_populated);
 
         // Populate FM1 and FM
-        for (int b = TURN+1; b <= seq.len() - 1; ++b) {
-#pragma omp parallel for shared(seq)
-            for (int i = 0; i <= seq.len() - 1 - b; ++i) {
-                populate_subopt_tables(i, i+b, seq);
-            }
-        }
+        tiled_wavefront(seq.len(), TURN+1, [this, &seq](int i, int j) {
+                populate_subopt_tables(i, j, seq);
+            });
         seq.subopt_tables_populated = true;
     }
 
-    void NNTM::populate_subopt_tables(int i, int j, RNASequenceWithTables& seq) const {
+    template <typename E>
+    void BasicNNTM<E>::populate_subopt_tables(int i, int j, RNASequenceWithTables& seq) const {
         // FM begin
-        std::deque<Rational> fm1_vals;
-        fm1_vals.push_back(Rational::infinity());
+        std::deque<E> fm1_vals;
+        fm1_vals.push_back(E::infinity());
 
         int minl = i+TURN+1;
         for (int l = minl; l <= j; ++l) {
@@ -54,9 +61,9 @@ namespace pmfe {
 
             case CHOOSE_DANGLE:
             {
-                Rational d5 = Ed5(i+1, l, seq);
-                Rational d3 = Ed3(i, l-1, seq);
-                Rational d53 = Ed5(i+1, l-1, seq) + Ed3(i+1, l-1, seq);
+                E d5 = Ed5(i+1, l, seq);
+                E d3 = Ed3(i, l-1, seq);
+                E d53 = Ed5(i+1, l-1, seq) + Ed3(i+1, l-1, seq);
 
                 fm1_vals.push_back(seq.V[i][l] + auPenalty(i, l, seq) + constants.multConst[1] * (j-l) + constants.multConst[2]);
 
@@ -74,8 +81,8 @@ namespace pmfe {
 
             case BOTH_DANGLE:
             {
-                Rational d5 = Ed5(i, l, seq);
-                Rational d3 = Ed3(i, l, seq);
+                E d5 = Ed5(i, l, seq);
+                E d3 = Ed3(i, l, seq);
                 fm1_vals.push_back(seq.V[i][l] + auPenalty(i, l, seq) + d5 + d3 + constants.multConst[1] * (j-l) + constants.multConst[2]);
                 break;
             }
@@ -89,8 +96,8 @@ namespace pmfe {
         }
         seq.FM1[i][j] = *std::min_element(fm1_vals.begin(), fm1_vals.end());
 
-        std::deque<Rational> fm_vals;
-        fm_vals.push_back(Rational::infinity());
+        std::deque<E> fm_vals;
+        fm_vals.push_back(E::infinity());
 
         for (int k = i+TURN+1; k <= j-TURN-1; ++k) {
             fm_vals.push_back(seq.FM[i][k-1] + seq.FM1[k][j]);
@@ -102,72 +109,235 @@ namespace pmfe {
         seq.FM[i][j] = *std::min_element(fm_vals.begin(), fm_vals.end());
     }
 
-    std::vector<RNAStructureWithScore> NNTM::suboptimal_structures(RNASequenceWithTables& seq, Rational delta, bool sorted, bool transform) const {
+    template <typename E>
+    std::vector<RNAStructureWithScore> BasicNNTM<E>::suboptimal_structures(RNASequenceWithTables& seq, Rational delta, bool sorted, bool transform, bool verify) const {
+        std::vector<RNAStructureWithScore> possible_structures;
+        visit_suboptimal_structures(seq, delta, [&possible_structures](const RNAStructureWithScore& structure) {
+                possible_structures.push_back(structure);
+            }, transform, verify);
+
+        if (sorted) {
+            // Break ties by the structure itself, so the order does not depend on how the enumeration was scheduled
+            std::sort(possible_structures.begin(), possible_structures.end(),
+                      [](const RNAStructureWithScore& a, const RNAStructureWithScore& b) {
+                          if (a < b or b < a) {
+                              return a < b;
+                          }
+                          return a.string() < b.string();
+                      });
+        }
+
+        return possible_structures;
+    }
+
+    template <typename E>
+    void BasicNNTM<E>::visit_suboptimal_structures(RNASequenceWithTables& seq, Rational delta, const StructureVisitor& visit, bool transform, bool verify) const {
+        /*
+          Enumerate the structures within delta of the MFE in stack order, without storing them
+        */
         // Ensure tables are available
         if (not seq.subopt_tables_populated) {
             populate_subopt_tables(seq);
         }
 
         // Set up variables
-        Rational mfe = minimum_energy(seq);
-        Rational upper_bound = mfe + delta;
+        E mfe = minimum_energy(seq);
+        E upper_bound = mfe + from_rational(delta);
+
+        int threads = omp_get_max_threads();
+        if (threads <= 1) {
+            // The arena must outlive every partial structure on the stack
+            typename RNAPartialStructure::Arena arena;
+            PartialStructureStack pstack;
+
+            // Construct the initial partial sequence and add it to the stack
+            RNAPartialStructure first(seq, arena);
+            first.push(Segment(0, seq.len()-1, lW, mfe));
+            pstack.push(first);
+
+            // Main processing loop
+            while (not pstack.empty()) {
+                RNAPartialStructure ps = std::move(pstack.top());
+                pstack.pop();
+                subopt_expand(seq, ps, pstack, upper_bound, visit, transform, verify);
+            }
+        } else {
+            /*
+              Every thread runs the same loop on its own deque of partial structures, allocated from its own arena,
+              and steals from the other threads when it runs out. The visitor is called by one thread at a time.
+            */
+            std::vector<typename RNAPartialStructure::Arena> arenas(threads);
+            std::mutex visit_lock;
+            StructureVisitor locked_visit = [&visit, &visit_lock](const RNAStructureWithScore& structure) {
+                std::lock_guard<std::mutex> guard(visit_lock);
+                visit(structure);
+            };
 
-        PartialStructureStack pstack;
-        std::vector<RNAStructureWithScore> possible_structures;
+            RNAPartialStructure first(seq, arenas[0]);
+            first.push(Segment(0, seq.len()-1, lW, mfe));
+
+            work_stealing_traversal(
+                threads,
+                std::move(first),
+                [&](int thread, RNAPartialStructure& ps, std::vector<RNAPartialStructure>& children) {
+                    PartialStructureStack pstack;
+                    subopt_expand(seq, ps, pstack, upper_bound, locked_visit, transform, verify);
+
+                    // Hand the new partial structures back bottom first, as they were pushed
+                    while (not pstack.empty()) {
+                        children.push_back(std::move(pstack.top()));
+                        pstack.pop();
+                    }
+                    std::reverse(children.begin(), children.end());
+                },
+                [&arenas](int thread, const RNAPartialStructure& ps) {
+                    return ps.adopted(arenas[thread]);
+                });
+        }
+    }
+
+    template <typename E>
+    void BasicNNTM<E>::visit_best_suboptimal_structures(RNASequenceWithTables& seq, Rational delta, std::size_t count, const StructureVisitor& visit, bool transform, bool verify) const {
+        subopt_best_first(seq, delta, count, visit, transform, verify, false);
+    }
 
-        // Construct the initial partial sequence and add it to the stack
-        RNAPartialStructure first(seq);
+    template <typename E>
+    void BasicNNTM<E>::visit_shape_structures(RNASequenceWithTables& seq, Rational delta, const StructureVisitor& visit, bool transform, bool verify) const {
+        subopt_best_first(seq, delta, std::numeric_limits<std::size_t>::max(), visit, transform, verify, true);
+    }
+
+    template <typename E>
+    void BasicNNTM<E>::subopt_best_first(RNASequenceWithTables& seq, Rational delta, std::size_t count, const StructureVisitor& visit, bool transform, bool verify, bool distinct_shapes) const {
+        /*
+          Expand the partial structures in order of their known energy, which is the least energy of any completion.
+          Complete structures then leave the queue in increasing energy order, so the search stops after the first count.
+
+          Two partial structures with the same pending segments have the same completions, and if their marked pairs
+          also have the same shape around those segments, each completion gives both the same shape. So when only the
+          best structure of each shape is wanted, a partial structure can be dropped when one with the same shape
+          key has already left the queue, since that one had no greater energy.
+        */
+        // Ensure tables are available
+        if (not seq.subopt_tables_populated) {
+            populate_subopt_tables(seq);
+        }
+
+        // Set up variables
+        E mfe = minimum_energy(seq);
+        E upper_bound = mfe + from_rational(delta);
+
+        struct QueuedStructure {
+            E energy;
+            long order; // Breaks ties by age, so the output does not depend on the queue implementation
+            RNAPartialStructure ps;
+
+            bool operator<(const QueuedStructure& other) const { // Reversed, so the queue yields the least energy first
+                if (energy != other.energy) {
+                    return other.energy < energy;
+                }
+                return other.order < order;
+            };
+        };
+
+        typename RNAPartialStructure::Arena arena;
+        std::priority_queue<QueuedStructure> queue;
+        long pushed = 0;
+
+        RNAPartialStructure first(seq, arena);
         first.push(Segment(0, seq.len()-1, lW, mfe));
-        pstack.push(first);
-
-        // Main processing loop
-        while (not pstack.empty()) {
-            RNAPartialStructure ps = pstack.top();
-            pstack.pop();
-
-            if (ps.empty() ) {
-                // In this case, this structure is fully evaluated
-                // Score the structure
-                RNAStructure structure = ps;
-                ScoreVector score = this->score(structure);
-                RNAStructureWithScore result(structure, score);
-                // Set transfromed value for saving.
-                result.transformed = transform;
-
-                if (ps.total() != score.energy) {
-                    BOOST_LOG_TRIVIAL(error) << "Inconsistent subopt energy: " << ps.total().get_d() << " ≅ " << score.energy.get_d();
-                    BOOST_LOG_TRIVIAL(error) << ps;
+        queue.push(QueuedStructure {first.total(), pushed++, first});
+
+        std::size_t found = 0;
+        StructureVisitor counted_visit = [&visit, &found](const RNAStructureWithScore& structure) {
+            visit(structure);
+            ++found;
+        };
+
+        std::unordered_set<std::string> shapes;
+
+        PartialStructureStack pstack;
+        while (found < count and not queue.empty()) {
+            RNAPartialStructure ps = queue.top().ps;
+            queue.pop();
+
+            if (distinct_shapes and not shapes.insert(ps.shape()).second) {
+                continue;
+            }
+
+            subopt_expand(seq, ps, pstack, upper_bound, counted_visit, transform, verify);
+
+            while (not pstack.empty()) {
+                // With an unbounded delta, drop the partial structures which have no finite completion
+                if (pstack.top().total().isFinite()) {
+                    queue.push(QueuedStructure {pstack.top().total(), pushed++, std::move(pstack.top())});
+                }
+                pstack.pop();
+            }
+        }
+    }
+
+    template <typename E>
+    void BasicNNTM<E>::subopt_expand(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound, const StructureVisitor& visit, bool transform, bool verify) const {
+        /*
+          Process one partial structure taken from the stack, visiting it if it is complete
+          and pushing its refinements otherwise
+        */
+        if (ps.empty() ) {
+            // In this case, this structure is fully evaluated
+            RNAStructure structure = ps.structure();
+            Rational energy = to_rational(ps.total());
+            ScoreVector score;
+
+            const ParameterVector& params = constants.params;
+            if (verify or params.dummy_scaling <= 0) {
+                // Rescore the structure from scratch
+                score = this->score(structure);
+
+                if (energy != score.energy) {
+                    BOOST_LOG_TRIVIAL(error) << "Inconsistent subopt energy: " << energy.get_d() << " ≅ " << score.energy.get_d();
+                    BOOST_LOG_TRIVIAL(error) << structure;
                     BOOST_LOG_TRIVIAL(error) << constants.params;
                     throw std::logic_error("Inconsistent energy in suboptimal structure calculation.");
                 }
 
-                if (ps.total() > upper_bound) {
-                    BOOST_LOG_TRIVIAL(error) << "Invalid subopt energy: " << ps.total().get_d() << " > " << upper_bound.get_d() << " (upper bound)";
-                    BOOST_LOG_TRIVIAL(error) << ps;
+                if (verify and (score.multiloops != ps.multiloop_count() or score.unpaired != ps.unpaired_count() or score.branches != ps.branch_count())) {
+                    BOOST_LOG_TRIVIAL(error) << "Inconsistent subopt counts: (" << ps.multiloop_count() << ", " << ps.unpaired_count() << ", " << ps.branch_count() << ") ≅ (" << score.multiloops << ", " << score.unpaired << ", " << score.branches << ")";
+                    BOOST_LOG_TRIVIAL(error) << structure;
                     BOOST_LOG_TRIVIAL(error) << constants.params;
-                    throw std::logic_error("Invalid energy in suboptimal structure calculation.");
+                    throw std::logic_error("Inconsistent multiloop counts in suboptimal structure calculation.");
                 }
-
-                possible_structures.push_back(result);
             } else {
-                // Otherwise, we need to process the structure
-                bool pushed_something = subopt_process_top_structure(seq, ps, pstack, upper_bound);
+                // Use the counts collected during the traceback, which determine w as in score()
+                Rational multiloop_energy = ps.multiloop_count() * params.multiloop_penalty + ps.unpaired_count() * params.unpaired_penalty + ps.branch_count() * params.branch_penalty;
+                Rational w = (energy - multiloop_energy) / params.dummy_scaling;
+                score = ScoreVector(ps.multiloop_count(), ps.unpaired_count(), ps.branch_count(), w, energy);
+            }
 
-                // If nothing was pushed to the stack, we still need to consider the rest of the partial-structure stack
-                if (not pushed_something) {
-                    pstack.push(ps);
-                }
+            RNAStructureWithScore result(structure, score);
+            // Set transfromed value for saving.
+            result.transformed = transform;
+
+            if (ps.total() > upper_bound) {
+                BOOST_LOG_TRIVIAL(error) << "Invalid subopt energy: " << to_rational(ps.total()).get_d() << " > " << to_rational(upper_bound).get_d() << " (upper bound)";
+                BOOST_LOG_TRIVIAL(error) << structure;
+                BOOST_LOG_TRIVIAL(error) << constants.params;
+                throw std::logic_error("Invalid energy in suboptimal structure calculation.");
             }
-        }
 
-        if (sorted) {
-            std::sort(possible_structures.begin(), possible_structures.end());
-        }
+            visit(result);
+        } else {
+            // Otherwise, we need to process the structure
+            bool pushed_something = subopt_process_top_structure(seq, ps, pstack, upper_bound);
 
-        return possible_structures;
+            // If nothing was pushed to the stack, we still need to consider the rest of the partial-structure stack
+            if (not pushed_something) {
+                pstack.push(std::move(ps));
+            }
+        }
     }
 
-    bool NNTM::subopt_process_top_structure(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_process_top_structure(const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const {
         // Take the top structure from the stack
         Segment seg = ps.top();
         ps.pop();
@@ -200,6 +370,10 @@ namespace pmfe {
             pushed_something = subopt_traceM1(seg.i, seg.j, seq, ps, pstack, upper_bound);
             break;
 
+        case lVP:
+            pushed_something = subopt_traceV(seg.i, seg.j, seq, ps, pstack, upper_bound, true);
+            break;
+
         default:
             throw std::logic_error("Invalid label on suboptimal segment.");
             break;
@@ -207,7 +381,8 @@ namespace pmfe {
         return pushed_something;
     };
 
-    bool NNTM::subopt_traceV(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_traceV(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound, bool stacked) const {
         // Input specification
         assert (0 <= i);
         assert (i <= j);
@@ -215,19 +390,35 @@ namespace pmfe {
 
         bool pushed_something = false;
 
+        // Without lonely pairs, a pair enclosed by any loop but a stack must stack on (i+1, j-1), which may close any loop
+        if (no_lonely_pairs and not stacked) {
+            if (eS(i, j, seq) + seq.VP[i+1][j-1] + ps.total() <= upper_bound) {
+                RNAPartialStructure new_ps(ps);
+                new_ps.push(Segment(i+1, j-1, lVP, seq.VP[i+1][j-1]));
+                new_ps.accumulate(eS(i, j, seq));
+                new_ps.mark_pair(i, j);
+                pstack.push(new_ps);
+                pushed_something = true;
+            }
+            return pushed_something;
+        }
+        const TriangularTable<E>& inner = no_lonely_pairs ? seq.VP : seq.V;
+        subopt_label inner_label = no_lonely_pairs ? lVP : lV;
+
         // Hairpin Loop
-        if (eH(i, j, seq) + ps.total() <= upper_bound) {
+        E hairpin = eH(i, j, seq);
+        if (hairpin + ps.total() <= upper_bound) {
             RNAPartialStructure new_ps(ps);
-            new_ps.accumulate(eH(i, j, seq));
+            new_ps.accumulate(hairpin);
             new_ps.mark_pair(i, j);
             pstack.push(new_ps);
             pushed_something = true;
         }
 
         // Stack
-        if (eS(i, j, seq) + seq.V[i+1][j-1] + ps.total() <= upper_bound) {
+        if (eS(i, j, seq) + inner[i+1][j-1] + ps.total() <= upper_bound) {
             RNAPartialStructure new_ps(ps);
-            new_ps.push(Segment(i+1, j-1, lV, seq.V[i+1][j-1]));
+            new_ps.push(Segment(i+1, j-1, inner_label, inner[i+1][j-1]));
             new_ps.accumulate(eS(i, j, seq));
             new_ps.mark_pair(i, j);
             pstack.push(new_ps);
@@ -247,14 +438,14 @@ namespace pmfe {
             switch (dangles) {
             case NO_DANGLE:
             {
-                Rational kenergy1 = seq.FM[i+1][k] + seq.FM1[k+1][j-1];
-                Rational kenergy2 = auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2];
-                Rational kenergy_total = kenergy1 + kenergy2;
+                E kenergy1 = seq.FM[i+1][k] + seq.FM1[k+1][j-1];
+                E kenergy2 = auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2];
+                E kenergy_total = kenergy1 + kenergy2;
                 if (kenergy_total + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+1, k, lM, seq.FM[i+1][k]));
                     new_ps.push(Segment(k+1, j-1, lM1, seq.FM1[k+1][j-1]));
-                    new_ps.accumulate(kenergy2);
+                    new_ps.accumulate(kenergy2, 1, 0, 1);
                     new_ps.mark_pair(i, j);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -265,14 +456,14 @@ namespace pmfe {
             case CHOOSE_DANGLE:
                 // In CHOOSE_DANGLE mode, we need to consider dangles on the initiating pair of a multiloop
             {
-                Rational d5 = Ed5(i, j, seq, true);
-                Rational d3 = Ed3(i, j, seq, true);
-                Rational d53 = d5 + d3;
+                E d5 = Ed5(i, j, seq, true);
+                E d3 = Ed3(i, j, seq, true);
+                E d53 = d5 + d3;
                 if (seq.FM[i+1][k] + seq.FM1[k+1][j-1] + auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2] + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+1, k, lM, seq.FM[i+1][k]));
                     new_ps.push(Segment(k+1, j-1, lM1, seq.FM1[k+1][j-1]));
-                    new_ps.accumulate(auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2]);
+                    new_ps.accumulate(auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2], 1, 0, 1);
                     new_ps.mark_pair(i, j);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -281,7 +472,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+2, k, lM, seq.FM[i+2][k]));
                     new_ps.push(Segment(k+1, j-1, lM1, seq.FM1[k+1][j-1]));
-                    new_ps.accumulate(auPenalty(i, j, seq) + d5 + constants.multConst[0] + constants.multConst[1] + constants.multConst[2]);
+                    new_ps.accumulate(auPenalty(i, j, seq) + d5 + constants.multConst[0] + constants.multConst[1] + constants.multConst[2], 1, 1, 1);
                     new_ps.mark_pair(i, j);
                     new_ps.mark_d3(i+1);
                     pstack.push(new_ps);
@@ -291,7 +482,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+1, k, lM, seq.FM[i+1][k]));
                     new_ps.push(Segment(k+1, j-2, lM1, seq.FM1[k+1][j-2]));
-                    new_ps.accumulate(auPenalty(i, j, seq) + d3 + constants.multConst[0] + constants.multConst[1] + constants.multConst[2]);
+                    new_ps.accumulate(auPenalty(i, j, seq) + d3 + constants.multConst[0] + constants.multConst[1] + constants.multConst[2], 1, 1, 1);
                     new_ps.mark_pair(i, j);
                     new_ps.mark_d5(j-1);
                     pstack.push(new_ps);
@@ -301,7 +492,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+2, k, lM, seq.FM[i+2][k]));
                     new_ps.push(Segment(k+1, j-2, lM1, seq.FM1[k+1][j-2]));
-                    new_ps.accumulate(auPenalty(i, j, seq) + d53 + constants.multConst[0] + 2*constants.multConst[1] + constants.multConst[2]);
+                    new_ps.accumulate(auPenalty(i, j, seq) + d53 + constants.multConst[0] + 2*constants.multConst[1] + constants.multConst[2], 1, 2, 1);
                     new_ps.mark_pair(i, j);
                     new_ps.mark_d3(i+1);
                     new_ps.mark_d5(j-1);
@@ -313,16 +504,16 @@ namespace pmfe {
 
             case BOTH_DANGLE:
             {
-                Rational d5 = Ed5(i, j, seq, true);
-                Rational d3 = Ed3(i, j, seq, true);
-                Rational kenergy1 = seq.FM[i+1][k] + seq.FM1[k+1][j-1];
-                Rational kenergy2 = d5 + d3 + auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2];
-                Rational kenergy_total = kenergy1 + kenergy2;
+                E d5 = Ed5(i, j, seq, true);
+                E d3 = Ed3(i, j, seq, true);
+                E kenergy1 = seq.FM[i+1][k] + seq.FM1[k+1][j-1];
+                E kenergy2 = d5 + d3 + auPenalty(i, j, seq) + constants.multConst[0] + constants.multConst[2];
+                E kenergy_total = kenergy1 + kenergy2;
                 if (kenergy_total + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i+1, k, lM, seq.FM[i+1][k]));
                     new_ps.push(Segment(k+1, j-1, lM1, seq.FM1[k+1][j-1]));
-                    new_ps.accumulate(kenergy2);
+                    new_ps.accumulate(kenergy2, 1, 0, 1);
                     new_ps.mark_pair(i, j);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -341,7 +532,8 @@ namespace pmfe {
         return pushed_something;
     }
 
-    bool NNTM::subopt_traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const {
         // Input specification
         assert (0 <= i);
         assert (i < j);
@@ -361,11 +553,12 @@ namespace pmfe {
             }
 
             for (int q = minq; q <= maxq; ++q) {
-                if (seq.V[p][q] + eL(i, j, p, q, seq) + ps.total() <= upper_bound) {
+                E loop = eL(i, j, p, q, seq);
+                if (seq.V[p][q] + loop + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(p, q, lV, seq.V[p][q]));
                     new_ps.mark_pair(i, j);
-                    new_ps.accumulate(eL(i, j, p, q, seq));
+                    new_ps.accumulate(loop);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -376,7 +569,8 @@ namespace pmfe {
     }
 
     // Wuchty case E = F
-    bool NNTM::subopt_traceW(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_traceW(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const {
         // Input specification
         assert (i == 0);
         assert (i < j);
@@ -384,17 +578,17 @@ namespace pmfe {
 
         bool pushed_something = false;
         for (int l = i; l < j-TURN; ++l) {
-            Rational wim1;
+            E wim1;
             if (l > 0) {
                 wim1 = seq.W[l-1];
             } else {
-                wim1 = 0;
+                wim1 = E(0);
             }
 
             switch (dangles){
             case NO_DANGLE:
             {
-                Rational bonus = auPenalty(l, j, seq);
+                E bonus = auPenalty(l, j, seq);
                 if (seq.V[l][j] + wim1 + bonus + ps.total() <= upper_bound ) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(l, j, lV, seq.V[l][j]));
@@ -408,9 +602,9 @@ namespace pmfe {
 
             case CHOOSE_DANGLE:
             {
-                Rational d5 = Ed5(l+1, j, seq);
-                Rational d3 = Ed3(l, j-1, seq);
-                Rational d53 = Ed5(l+1, j-1, seq) + Ed3(l+1, j-1, seq);
+                E d5 = Ed5(l+1, j, seq);
+                E d3 = Ed3(l, j-1, seq);
+                E d53 = Ed5(l+1, j-1, seq) + Ed3(l+1, j-1, seq);
 
                 if (seq.V[l][j] + auPenalty(l, j, seq) + wim1 + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
@@ -453,7 +647,7 @@ namespace pmfe {
 
             case BOTH_DANGLE:
             {
-                Rational bonus = auPenalty(l, j, seq);
+                E bonus = auPenalty(l, j, seq);
 
                 if (l > i) {
                     bonus += Ed5(l, j, seq);
@@ -490,7 +684,8 @@ namespace pmfe {
         return pushed_something;
     }
 
-    bool NNTM::subopt_traceM1(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_traceM1(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const {
         // Input specification
         assert (0 <= i);
         assert (i < j);
@@ -501,7 +696,7 @@ namespace pmfe {
         if (seq.FM1[i][j-1] + constants.multConst[1] + ps.total() <= upper_bound) {
             RNAPartialStructure new_ps(ps);
             new_ps.push(Segment(i, j-1, lM1, seq.FM1[i][j-1]));
-            new_ps.accumulate(constants.multConst[1]);
+            new_ps.accumulate(constants.multConst[1], 0, 1, 0);
             pstack.push(new_ps);
             pushed_something = true;
         }
@@ -509,11 +704,11 @@ namespace pmfe {
         switch (dangles) {
         case NO_DANGLE:
         {
-            Rational bonus = auPenalty(i, j, seq) + constants.multConst[2];
+            E bonus = auPenalty(i, j, seq) + constants.multConst[2];
             if (seq.V[i][j] + bonus + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(bonus);
+                new_ps.accumulate(bonus, 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
@@ -522,20 +717,20 @@ namespace pmfe {
 
         case CHOOSE_DANGLE:
         {
-            Rational d5 = Ed5(i+1, j, seq);
-            Rational d3 = Ed3(i, j-1, seq);
-            Rational d53 = Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
+            E d5 = Ed5(i+1, j, seq);
+            E d3 = Ed3(i, j-1, seq);
+            E d53 = Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
             if (seq.V[i][j] + auPenalty(i, j, seq) + constants.multConst[2] + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(auPenalty(i, j, seq) + constants.multConst[2]);
+                new_ps.accumulate(auPenalty(i, j, seq) + constants.multConst[2], 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
             if (i+1 < j and seq.V[i+1][j] + auPenalty(i+1, j, seq) + constants.multConst[2] + constants.multConst[1] + d5 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i+1, j, lV, seq.V[i+1][j]));
-                new_ps.accumulate(auPenalty(i+1, j, seq) + constants.multConst[2] + constants.multConst[1] + d5);
+                new_ps.accumulate(auPenalty(i+1, j, seq) + constants.multConst[2] + constants.multConst[1] + d5, 0, 1, 1);
                 new_ps.mark_d5(i);
                 pstack.push(new_ps);
                 pushed_something = true;
@@ -543,7 +738,7 @@ namespace pmfe {
             if (i < j-1 and seq.V[i][j-1] + auPenalty(i, j-1, seq) + constants.multConst[2] + constants.multConst[1] + d3 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j-1, lV, seq.V[i][j-1]));
-                new_ps.accumulate(auPenalty(i, j-1, seq) + constants.multConst[2] + constants.multConst[1] + d3);
+                new_ps.accumulate(auPenalty(i, j-1, seq) + constants.multConst[2] + constants.multConst[1] + d3, 0, 1, 1);
                 new_ps.mark_d3(j);
                 pstack.push(new_ps);
                 pushed_something = true;
@@ -551,7 +746,7 @@ namespace pmfe {
             if (i+1 < j-1 and seq.V[i+1][j-1] + auPenalty(i+1, j-1, seq) + constants.multConst[2] + 2*constants.multConst[1] + d53 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i+1, j-1, lV, seq.V[i+1][j-1]));
-                new_ps.accumulate(auPenalty(i+1, j-1, seq) + constants.multConst[2] + 2*constants.multConst[1] + d53);
+                new_ps.accumulate(auPenalty(i+1, j-1, seq) + constants.multConst[2] + 2*constants.multConst[1] + d53, 0, 2, 1);
                 new_ps.mark_d5(i);
                 new_ps.mark_d3(j);
                 pstack.push(new_ps);
@@ -562,11 +757,11 @@ namespace pmfe {
 
         case BOTH_DANGLE:
         {
-            Rational bonus = Ed5(i, j, seq) + Ed3(i, j, seq) + auPenalty(i, j, seq) + constants.multConst[2];
+            E bonus = Ed5(i, j, seq) + Ed3(i, j, seq) + auPenalty(i, j, seq) + constants.multConst[2];
             if (seq.V[i][j] + bonus + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(bonus);
+                new_ps.accumulate(bonus, 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
@@ -583,7 +778,8 @@ namespace pmfe {
         return pushed_something;
     }
 
-    bool NNTM::subopt_traceM(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, Rational upper_bound) const {
+    template <typename E>
+    bool BasicNNTM<E>::subopt_traceM(int i, int j, const RNASequenceWithTables& seq, RNAPartialStructure& ps, PartialStructureStack& pstack, E upper_bound) const {
         // Input specification
         assert (0 <= i);
         assert (i < j);
@@ -594,7 +790,7 @@ namespace pmfe {
         if (seq.FM[i][j-1] + constants.multConst[1] + ps.total() <= upper_bound) {
             RNAPartialStructure new_ps(ps);
             new_ps.push(Segment(i, j-1, lM, seq.FM[i][j-1]));
-            new_ps.accumulate(constants.multConst[1]);
+            new_ps.accumulate(constants.multConst[1], 0, 1, 0);
             pstack.push(new_ps);
             pushed_something = true;
         }
@@ -603,11 +799,11 @@ namespace pmfe {
         switch (dangles) {
         case NO_DANGLE:
         {
-            Rational bonus = constants.multConst[2] + auPenalty(i, j, seq);
+            E bonus = constants.multConst[2] + auPenalty(i, j, seq);
             if (seq.V[i][j] + bonus + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(bonus);
+                new_ps.accumulate(bonus, 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
@@ -616,20 +812,20 @@ namespace pmfe {
 
         case CHOOSE_DANGLE:
         {
-            Rational d5 = Ed5(i+1, j, seq);
-            Rational d3 = Ed3(i, j-1, seq);
-            Rational d53 = Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
+            E d5 = Ed5(i+1, j, seq);
+            E d3 = Ed3(i, j-1, seq);
+            E d53 = Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
             if (seq.V[i][j] + constants.multConst[2] + auPenalty(i, j, seq) + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(constants.multConst[2] + auPenalty(i, j, seq));
+                new_ps.accumulate(constants.multConst[2] + auPenalty(i, j, seq), 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
             if (i+1 < j and seq.V[i+1][j] + constants.multConst[2] + constants.multConst[1] + auPenalty(i+1, j, seq) + d5 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i+1, j, lV, seq.V[i+1][j]));
-                new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(i+1, j, seq) + d5);
+                new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(i+1, j, seq) + d5, 0, 1, 1);
                 new_ps.mark_d5(i);
                 pstack.push(new_ps);
                 pushed_something = true;
@@ -637,7 +833,7 @@ namespace pmfe {
             if (i < j-1 and seq.V[i][j-1] + constants.multConst[2] + constants.multConst[1] + auPenalty(i, j-1, seq) + d3 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j-1, lV, seq.V[i][j-1]));
-                new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(i, j-1, seq) + d3);
+                new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(i, j-1, seq) + d3, 0, 1, 1);
                 new_ps.mark_d3(j);
                 pstack.push(new_ps);
                 pushed_something = true;
@@ -645,7 +841,7 @@ namespace pmfe {
             if (i+1 < j-1 and seq.V[i+1][j-1] + constants.multConst[2] + 2*constants.multConst[1] + auPenalty(i+1, j-1, seq) + d53 + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i+1, j-1, lV, seq.V[i+1][j-1]));
-                new_ps.accumulate(constants.multConst[2] + 2*constants.multConst[1] + auPenalty(i+1, j-1, seq) + d53);
+                new_ps.accumulate(constants.multConst[2] + 2*constants.multConst[1] + auPenalty(i+1, j-1, seq) + d53, 0, 2, 1);
                 new_ps.mark_d5(i);
                 new_ps.mark_d3(j);
                 pstack.push(new_ps);
@@ -656,11 +852,11 @@ namespace pmfe {
 
         case BOTH_DANGLE:
         {
-            Rational bonus = Ed5(i, j, seq) + Ed3(i, j, seq) + auPenalty(i, j, seq) + constants.multConst[2];
+            E bonus = Ed5(i, j, seq) + Ed3(i, j, seq) + auPenalty(i, j, seq) + constants.multConst[2];
             if (seq.V[i][j] + bonus + ps.total() <= upper_bound) {
                 RNAPartialStructure new_ps(ps);
                 new_ps.push(Segment(i, j, lV, seq.V[i][j]));
-                new_ps.accumulate(bonus);
+                new_ps.accumulate(bonus, 0, 0, 1);
                 pstack.push(new_ps);
                 pushed_something = true;
             }
@@ -679,12 +875,12 @@ namespace pmfe {
             switch (dangles) {
             case NO_DANGLE:
             {
-                Rational bonus = constants.multConst[2] + auPenalty(k+1, j, seq);
+                E bonus = constants.multConst[2] + auPenalty(k+1, j, seq);
                 if (seq.FM[i][k] + seq.V[k+1][j] + bonus + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(bonus);
+                    new_ps.accumulate(bonus, 0, 0, 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -693,14 +889,14 @@ namespace pmfe {
 
             case CHOOSE_DANGLE:
             {
-                Rational d5 = Ed5(k+2, j, seq);
-                Rational d3 = Ed3(k+1, j-1, seq);
-                Rational d53 = Ed5(k+2, j-1, seq) + Ed3(k+2, j-1, seq);
+                E d5 = Ed5(k+2, j, seq);
+                E d3 = Ed3(k+1, j-1, seq);
+                E d53 = Ed5(k+2, j-1, seq) + Ed3(k+2, j-1, seq);
                 if (seq.FM[i][k] + seq.V[k+1][j] + constants.multConst[2] + auPenalty(k+1, j, seq) + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(constants.multConst[2] + auPenalty(k+1, j, seq));
+                    new_ps.accumulate(constants.multConst[2] + auPenalty(k+1, j, seq), 0, 0, 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -708,7 +904,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+2, j, lV, seq.V[k+2][j]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(k+2, j, seq) + d5);
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(k+2, j, seq) + d5, 0, 1, 1);
                     new_ps.mark_d5(k+1);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -717,7 +913,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+1, j-1, lV, seq.V[k+1][j-1]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(k+1, j-1, seq) + d3);
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1] + auPenalty(k+1, j-1, seq) + d3, 0, 1, 1);
                     new_ps.mark_d3(j);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -726,7 +922,7 @@ namespace pmfe {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+2, j-1, lV, seq.V[k+2][j-1]));
-                    new_ps.accumulate(constants.multConst[2] + 2*constants.multConst[1] + auPenalty(k+2, j-1, seq) + d53);
+                    new_ps.accumulate(constants.multConst[2] + 2*constants.multConst[1] + auPenalty(k+2, j-1, seq) + d53, 0, 2, 1);
                     new_ps.mark_d5(k+1);
                     new_ps.mark_d3(j);
                     pstack.push(new_ps);
@@ -737,12 +933,12 @@ namespace pmfe {
 
             case BOTH_DANGLE:
             {
-                Rational bonus = Ed5(k+1, j, seq) + Ed3(k+1, j, seq) + constants.multConst[2] + auPenalty(k+1, j, seq);
+                E bonus = Ed5(k+1, j, seq) + Ed3(k+1, j, seq) + constants.multConst[2] + auPenalty(k+1, j, seq);
                 if (seq.FM[i][k] + seq.V[k+1][j] + bonus + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(i, k, lM, seq.FM[i][k]));
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(bonus);
+                    new_ps.accumulate(bonus, 0, 0, 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -758,7 +954,7 @@ namespace pmfe {
         // case that there is a single branch, preceded by free bases ending at position k
         for (int k = i; k <= j-TURN-1; ++k) {
 
-            Rational bonus = 0;
+            E bonus = E(0);
 
             switch (dangles) {
             case NO_DANGLE:
@@ -767,7 +963,7 @@ namespace pmfe {
                 if (seq.V[k+1][j] + bonus + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(bonus);
+                    new_ps.accumulate(bonus, 0, (k-i+1), 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -776,20 +972,20 @@ namespace pmfe {
 
             case CHOOSE_DANGLE:
             {
-                Rational d5 = Ed5(k+2, j, seq);
-                Rational d3 = Ed3(k+1, j-1, seq);
-                Rational d53 = Ed5(k+2, j-1, seq) + Ed3(k+2, j-1, seq);
+                E d5 = Ed5(k+2, j, seq);
+                E d3 = Ed3(k+1, j-1, seq);
+                E d53 = Ed5(k+2, j-1, seq) + Ed3(k+2, j-1, seq);
                 if (seq.V[k+1][j] + constants.multConst[2] + constants.multConst[1]*(k+1 - i) + auPenalty(k+1, j, seq) + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+1 - i) + auPenalty(k+1, j, seq));
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+1 - i) + auPenalty(k+1, j, seq), 0, (k+1 - i), 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
                 if (k+2 <= j-TURN and seq.V[k+2][j] + constants.multConst[2] + constants.multConst[1]*(k+2 - i) + auPenalty(k+2, j, seq) + d5 + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+2, j, lV, seq.V[k+2][j]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+2 - i) + auPenalty(k+2, j, seq) + d5);
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+2 - i) + auPenalty(k+2, j, seq) + d5, 0, (k+2 - i), 1);
                     new_ps.mark_d5(k+1);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -797,7 +993,7 @@ namespace pmfe {
                 if (k+1 <= j-1-TURN and seq.V[k+1][j-1] + constants.multConst[2] + constants.multConst[1]*(k+1 - i + 1) + auPenalty(k+1, j-1, seq) + d3 + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+1, j-1, lV, seq.V[k+1][j-1]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+1 - i + 1) + auPenalty(k+1, j-1, seq) + d3);
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+1 - i + 1) + auPenalty(k+1, j-1, seq) + d3, 0, (k+1 - i + 1), 1);
                     new_ps.mark_d3(j);
                     pstack.push(new_ps);
                     pushed_something = true;
@@ -805,7 +1001,7 @@ namespace pmfe {
                 if (k+2 <= j-1-TURN and seq.V[k+2][j-1] + constants.multConst[2] + constants.multConst[1]*(k+2 - i + 1) + auPenalty(k+2, j-1, seq) + d53 + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+2, j-1, lV, seq.V[k+2][j-1]));
-                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+2 - i + 1) + auPenalty(k+2, j-1, seq) + d53);
+                    new_ps.accumulate(constants.multConst[2] + constants.multConst[1]*(k+2 - i + 1) + auPenalty(k+2, j-1, seq) + d53, 0, (k+2 - i + 1), 1);
                     new_ps.mark_d5(k+1);
                     new_ps.mark_d3(j);
                     pstack.push(new_ps);
@@ -816,11 +1012,11 @@ namespace pmfe {
 
             case BOTH_DANGLE:
             {
-                Rational bonus = Ed5(k+1, j, seq) + Ed3(k+1, j, seq) + constants.multConst[2] + constants.multConst[1]*(k-i+1) + auPenalty(k+1, j, seq);
+                E bonus = Ed5(k+1, j, seq) + Ed3(k+1, j, seq) + constants.multConst[2] + constants.multConst[1]*(k-i+1) + auPenalty(k+1, j, seq);
                 if (seq.V[k+1][j] + bonus + ps.total() <= upper_bound) {
                     RNAPartialStructure new_ps(ps);
                     new_ps.push(Segment(k+1, j, lV, seq.V[k+1][j]));
-                    new_ps.accumulate(bonus);
+                    new_ps.accumulate(bonus, 0, (k-i+1), 1);
                     pstack.push(new_ps);
                     pushed_something = true;
                 }
@@ -837,4 +1033,7 @@ namespace pmfe {
 
         return pushed_something;
     };
+
+    template class BasicNNTM<Rational>;
+    template class BasicNNTM<FixedEnergy>;
 }
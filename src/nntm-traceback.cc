@@ -19,7 +19,8 @@
 
 
 namespace pmfe {
-    RNAStructureWithScore NNTM::mfe_structure(const RNASequenceWithTables& seq) const {
+    template <typename E>
+    RNAStructureWithScore BasicNNTM<E>::mfe_structure(const RNASequenceWithTables& seq) const {
         RNAStructure structure(seq);
         ScoreVector score;
 
@@ -38,27 +39,28 @@ namespace pmfe {
         return result;
     }
 
-    bool NNTM::traceW(int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
+    template <typename E>
+    bool BasicNNTM<E>::traceW(int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
         bool found_something = false;
-        Rational wim1;
+        E wim1;
 
         if (j <= 0) {
-            return score.energy == seq.W[seq.len() - 1];
+            return score.energy == to_rational(seq.W[seq.len() - 1]);
         }
 
         for (int i = 0; i < j and not found_something; i++) {
             if (j-i < TURN) continue;
 
             if (i > 0) {
-                wim1 = std::min(Rational(0), seq.W[i-1]);
+                wim1 = std::min(E(0), seq.W[i-1]);
             } else {
-                wim1 = 0;
+                wim1 = E(0);
             }
 
             switch (dangles) {
             case BOTH_DANGLE:
             {
-                Rational e_dangles = 0;
+                E e_dangles = E(0);
                 if (i > 0) {
                     e_dangles += Ed5(i, j, seq);
                 }
@@ -69,9 +71,9 @@ namespace pmfe {
 
                 if (seq.W[j] == seq.V[i][j] + auPenalty(i, j, seq) + e_dangles + wim1) {
                     found_something = true;
-                    Rational loop = auPenalty(i, j, seq) + e_dangles;
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i, j, seq) + e_dangles;
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     traceV(i, j, seq, structure, score);
                     traceW(i-1, seq, structure, score);
                 };
@@ -82,9 +84,9 @@ namespace pmfe {
             {
                 if (seq.W[j] == seq.V[i][j] + auPenalty(i, j, seq) + wim1) {
                     found_something = true;
-                    Rational loop = auPenalty(i, j, seq);
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i, j, seq);
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     traceV(i, j, seq, structure, score);
                     traceW(i-1, seq, structure, score);
                 };
@@ -95,32 +97,32 @@ namespace pmfe {
             {
                 if (seq.W[j] == seq.V[i][j] + auPenalty(i, j, seq) + wim1) {
                     found_something = true;
-                    Rational loop = auPenalty(i, j, seq);
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i, j, seq);
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     traceV(i, j, seq, structure, score);
                     traceW(i-1, seq, structure, score);
                 } else if (seq.W[j] ==  seq.V[i][j-1] + auPenalty(i, j-1, seq) + Ed3(i, j-1, seq) + wim1) {
                     found_something = true;
-                    Rational loop = auPenalty(i, j-1, seq) + Ed3(i, j-1, seq);
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i, j-1, seq) + Ed3(i, j-1, seq);
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     structure.mark_d3(j);
                     traceV(i, j-1, seq, structure, score);
                     traceW(i-1, seq, structure, score);
                 } else if (seq.W[j] == seq.V[i+1][j] + auPenalty(i+1, j, seq) + Ed5(i+1, j, seq) + wim1){
                     found_something = true;
-                    Rational loop = auPenalty(i+1, j, seq) + Ed5(i+1, j, seq);
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i+1, j, seq) + Ed5(i+1, j, seq);
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     structure.mark_d5(i);
                     traceV(i + 1, j, seq, structure, score);
                     traceW(i-1, seq, structure, score);
                 } else if (seq.W[j] == seq.V[i+1][j-1] + auPenalty(i+1, j-1, seq) + Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq) + wim1) {
                     found_something = true;
-                    Rational loop = auPenalty(i+1, j-1, seq) + Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
-                    score.energy += loop;
-                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+                    E loop = auPenalty(i+1, j-1, seq) + Ed5(i+1, j-1, seq) + Ed3(i+1, j-1, seq);
+                    score.energy += to_rational(loop);
+                    BOOST_LOG_TRIVIAL(debug) << "ExtLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
                     structure.mark_d3(j);
                     structure.mark_d5(i);
                     traceV(i+1, j-1, seq, structure, score);
@@ -149,75 +151,95 @@ namespace pmfe {
         return found_something;
     }
 
-    Rational NNTM::traceV(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
-        Rational a, b, c, d;
-        Rational Vij;
-        if (j-i < TURN)  return Rational::infinity();
+    template <typename E>
+    E BasicNNTM<E>::traceV(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score, bool stacked) const {
+        E a, b, c, d;
+        E Vij;
+        if (j-i < TURN)  return E::infinity();
+
+        if (no_lonely_pairs and not stacked) {
+            // The only choice is to stack on (i+1, j-1)
+            structure.mark_pair(i, j);
+            E loop = eS(i, j, seq);
+            score.energy += to_rational(loop);
+            BOOST_LOG_TRIVIAL(debug) << "Stack (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
+            traceV(i+1, j-1, seq, structure, score, true);
+            return seq.V[i][j];
+        }
+
+        // Without lonely pairs, a pair stacked on this one may close any loop
+        const TriangularTable<E>& inner = no_lonely_pairs ? seq.VP : seq.V;
 
         // TODO: Eliminate silly intermediate variables
         a = eH(i, j, seq);
 
-        b = eS(i, j, seq) + seq.V[i + 1][j - 1];
+        b = eS(i, j, seq) + inner[i + 1][j - 1];
         c = seq.VBI[i][j];
         d = seq.VM[i][j];
 
-        Vij = seq.V[i][j];
+        Vij = stacked ? seq.VP[i][j] : seq.V[i][j];
         structure.mark_pair(i, j);
 
         if (Vij == a ) {
-            Rational loop = eH(i, j, seq);
-            score.energy += loop;
-            BOOST_LOG_TRIVIAL(debug) << "Hairpin (" << i << ", " << j << ") with energy " << loop.get_d();
+            E loop = a;
+            score.energy += to_rational(loop);
+            BOOST_LOG_TRIVIAL(debug) << "Hairpin (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
             return Vij;
         } else if (Vij == b) {
-            Rational loop = eS(i, j, seq);
-            score.energy += loop;
-            BOOST_LOG_TRIVIAL(debug) << "Stack (" << i << ", " << j << ") with energy " << loop.get_d();
-            traceV(i+1, j-1, seq, structure, score);
+            E loop = eS(i, j, seq);
+            score.energy += to_rational(loop);
+            BOOST_LOG_TRIVIAL(debug) << "Stack (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
+            traceV(i+1, j-1, seq, structure, score, no_lonely_pairs);
             return Vij;
         } else if (Vij == c) {
             traceVBI(i, j, seq, structure, score);
             return Vij;
         } else if (Vij == d) {
-            Rational loop = Vij - traceVM(i, j, seq, structure, score);
-            score.energy += loop;
-            BOOST_LOG_TRIVIAL(debug) << "Multiloop (" << i << ", " << j << ") with energy " << loop.get_d();
+            E loop = Vij - traceVM(i, j, seq, structure, score);
+            score.energy += to_rational(loop);
+            BOOST_LOG_TRIVIAL(debug) << "Multiloop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
             return Vij;
         }
 
-        return 0;
+        return E(0);
     }
 
-    Rational NNTM::traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
-        Rational VBIij;
+    template <typename E>
+    E BasicNNTM<E>::traceVBI(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
+        E VBIij;
         int ip, jp;
         int ifinal, jfinal;
 
         ifinal = 0;
         jfinal = 0;
 
-        for (ip = i + 1; ip < j - 1; ip++) {
-            for (jp = ip + 1; jp < j; jp++) {
+        // Search the same inner pairs as calcVBI, so the search is bounded by MAXLOOP
+        bool found = false;
+        for (ip = i + 1; ip <= std::min(j-2-TURN, i+MAXLOOP+1) and not found; ip++) {
+            int minjp = std::max(j-i+ip-MAXLOOP-2, ip+1+TURN);
+            int maxjp = (ip == i + 1) ? j - 2 : j - 1;
+            for (jp = minjp; jp <= maxjp; jp++) {
                 VBIij = eL(i, j, ip, jp, seq) + seq.V[ip][jp];
                 if (VBIij == seq.VBI[i][j]){
                     ifinal = ip;
                     jfinal = jp;
+                    found = true;
                     break;
                 }
             }
-            if (jp != j) break;
         }
 
-        Rational loop = eL(i, j, ifinal, jfinal, seq);
-        score.energy += loop;
+        E loop = eL(i, j, ifinal, jfinal, seq);
+        score.energy += to_rational(loop);
 
-        BOOST_LOG_TRIVIAL(debug) << "IntLoop (" << i << ", " << j << ") with energy " << loop.get_d();
+        BOOST_LOG_TRIVIAL(debug) << "IntLoop (" << i << ", " << j << ") with energy " << to_rational(loop).get_d();
 
         return traceV(ifinal, jfinal, seq, structure, score);
     }
 
-    Rational NNTM::traceVM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
-        Rational eVM = 0;
+    template <typename E>
+    E BasicNNTM<E>::traceVM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
+        E eVM = E(0);
 
         switch (dangles) {
         case BOTH_DANGLE:
@@ -257,7 +279,7 @@ namespace pmfe {
                 score.multiloops++;
                 score.branches++;
                 score.unpaired++;
-            } else if (seq.V[i][j] ==  seq.WMPrime[i+2][j-2] + constants.multConst[0] + constants.multConst[2] + auPenalty(i, j, seq) + Ed5(i, j, seq, true) + Ed3(i, j, seq, true) + constants.multConst[1]*2) {
+            } else if (seq.VM[i][j] == seq.WMPrime[i+2][j-2] + constants.multConst[0] + constants.multConst[2] + auPenalty(i, j, seq) + Ed5(i, j, seq, true) + Ed3(i, j, seq, true) + constants.multConst[1]*2) {
                 eVM += traceWMPrime(i+2, j-2, seq, structure, score);
                 structure.mark_d3(i+1);
                 structure.mark_d5(j-1);
@@ -277,9 +299,10 @@ namespace pmfe {
         return eVM;
     }
 
-    Rational NNTM::traceWMPrime(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
+    template <typename E>
+    E BasicNNTM<E>::traceWMPrime(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
         int done=0, h;
-        Rational energy = 0;
+        E energy = E(0);
 
         for (h = i; h < j and not done; h++) {
             if (seq.WM[i][h] + seq.WM[h+1][j] == seq.WMPrime[i][j]) {
@@ -292,10 +315,11 @@ namespace pmfe {
         return energy;
     }
 
-    Rational NNTM::traceWM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
+    template <typename E>
+    E BasicNNTM<E>::traceWM(int i, int j, const RNASequenceWithTables& seq, RNAStructure& structure, ScoreVector& score) const {
         assert(i < j);
         int done = 0;
-        Rational eWM = 0;
+        E eWM = E(0);
 
         if (not done and seq.WM[i][j] == seq.WMPrime[i][j]) {
             eWM += traceWMPrime(i, j, seq, structure, score);
@@ -373,4 +397,7 @@ namespace pmfe {
 
         return eWM;
     }
+
+    template class BasicNNTM<Rational>;
+    template class BasicNNTM<FixedEnergy>;
 }
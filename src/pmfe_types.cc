@@ -9,6 +9,8 @@
 
 #include <set>
 #include <deque>
+#include <sstream>
+#include <string>
 
 #include <assert.h>
 
@@ -24,6 +26,60 @@
 namespace pmfe {
     namespace fs = boost::filesystem;
 
+    namespace {
+        struct ShapeItem {
+            int i, j;
+            std::string token; // Empty for a pair, otherwise the text standing in for a pending segment
+        };
+
+        std::string render_shape(const std::vector<ShapeItem>& items, std::size_t& k) {
+            // Render items[k] and everything it encloses, leaving k at the next item outside it
+            const ShapeItem& item = items[k++];
+            if (not item.token.empty()) {
+                return item.token;
+            }
+
+            std::string inner;
+            int children = 0;
+            bool pair_child = false;
+            while (k < items.size() and items[k].i < item.j) {
+                pair_child = items[k].token.empty();
+                inner += render_shape(items, k);
+                ++children;
+            }
+
+            if (children == 1 and pair_child) {
+                // Stacks, bulges and interior loops continue the same helix
+                return inner;
+            }
+            return "[" + inner + "]";
+        }
+
+        std::string abstract_shape(std::vector<ShapeItem> items) {
+            // Outer items first, so each item is followed by the items it encloses
+            std::sort(items.begin(), items.end(), [](const ShapeItem& a, const ShapeItem& b) {
+                    if (a.i != b.i) {
+                        return a.i < b.i;
+                    }
+                    if (a.j != b.j) {
+                        return a.j > b.j;
+                    }
+                    return a.token < b.token;
+                });
+
+            std::string result;
+            std::size_t k = 0;
+            while (k < items.size()) {
+                result += render_shape(items, k);
+            }
+
+            if (result.empty()) {
+                result = "_";
+            }
+            return result;
+        }
+    }
+
     const Rational multiloop_default = Rational(17, 5);
     const Rational unpaired_default = Rational(0);
     const Rational branch_default = Rational(2, 5);
@@ -95,10 +151,29 @@ namespace pmfe {
 
     bool operator<(const ScoreVector& a, const ScoreVector& b) {
         // The most useful ordering on score vectors is lexicographic with energy first
-        std::vector<Rational> a_vect = {a.energy, a.multiloops, a.unpaired, a.branches, a.w};
-        std::vector<Rational> b_vect = {b.energy, b.multiloops, b.unpaired, b.branches, b.w};
+        // Compare field by field, since this is called for every comparison in a sort
+        if (a.energy != b.energy) {
+            return a.energy < b.energy;
+        }
+        if (a.multiloops != b.multiloops) {
+            return a.multiloops < b.multiloops;
+        }
+        if (a.unpaired != b.unpaired) {
+            return a.unpaired < b.unpaired;
+        }
+        if (a.branches != b.branches) {
+            return a.branches < b.branches;
+        }
+        return a.w < b.w;
+    }
 
-        return std::lexicographical_compare(a_vect.begin(), a_vect.end(), b_vect.begin(), b_vect.end());
+    std::size_t ScoreVectorHash::operator()(const ScoreVector& score) const {
+        // The energy is determined by the other entries, so it is left out
+        std::size_t result = score.multiloops.get_si();
+        result = result * 1000003 + score.unpaired.get_si();
+        result = result * 1000003 + score.branches.get_si();
+        result = result * 1000003 + std::hash<double>()(score.w.get_d());
+        return result;
     }
 
     ScoreVector& ScoreVector::operator+=(const ScoreVector& rhs) {
@@ -202,57 +277,29 @@ namespace pmfe {
     }
 
     void RNASequence::preprocess() {
-        // Apply some processing to each character of the seq_txt string
+        // Encode each base of the seq_txt string and capitalize it, throwing an exception if it is not valid
+        static const char capitals[4] = {'A', 'C', 'G', 'U'};
+        codes.resize(len());
         for (int i = 0; i < len(); ++i) {
-            // Capitalize if the base is valid, throw an exception if not
-            switch(base(i)) {
-            case BASE_A:
-                seq_txt[i] = 'A';
-                break;
-
-            case BASE_C:
-                seq_txt[i] = 'C';
-                break;
-
-            case BASE_G:
-                seq_txt[i] = 'G';
-                break;
-
-            case BASE_U:
-                seq_txt[i] = 'U';
-                break;
-
-            default:
+            int code = encode_base(seq_txt[i]);
+            if (code < 0) {
                 std::stringstream error_message;
                 error_message << "At position " << i << ", found " << seq_txt[i] << ", which is an invalid RNA base.";
                 throw std::invalid_argument(error_message.str());
-                break;
             }
-        }
-
-        // Populate valid_pairs
-        valid_pairs.resize(boost::extents[len()][len()]);
 
-        std::set<std::string> RNAPairs = {"AU", "UA", "CG", "GC", "GU", "UG"};
+            codes[i] = code;
+            seq_txt[i] = capitals[code];
+        }
 
+        // Populate c_counts
+        c_counts.assign(len() + 1, 0);
         for (int i = 0; i < len(); ++i) {
-            for (int j = i + 1; j < len(); ++j) {
-                std::string thepair = seq_txt.substr(i, 1) + seq_txt.substr(j, 1);
-                if (RNAPairs.count(thepair) == 0) {
-                    valid_pairs[i][j] = valid_pairs[j][i] = false;
-                } else {
-                    valid_pairs[i][j] = valid_pairs[j][i] = true;
-                }
-            }
+            c_counts[i + 1] = c_counts[i] + ((codes[i] == BASE_C) ? 1 : 0);
         }
     }
 
-    int RNASequence::len() const {
-        return seq_txt.length();
-    }
-
-    int RNASequence::base(int i) const {
-        char base = seq_txt[i];
+    int RNASequence::encode_base(char base) {
         switch(base) {
         case 'A':
         case 'a':
@@ -273,14 +320,19 @@ namespace pmfe {
         }
     }
 
+    int RNASequence::len() const {
+        return seq_txt.length();
+    }
+
     std::string RNASequence::subsequence(int i, int j) const {
         // Return the subsequence starting at i and ending at j (inclusive)
         assert(i <= j);
         return seq_txt.substr(i, j-i+1);
     }
 
-    bool RNASequence::can_pair(int i, int j) const {
-        return valid_pairs[i][j];
+    bool RNASequence::poly_c(int i, int j) const {
+        assert(i < j);
+        return c_counts[j] - c_counts[i + 1] == j - i - 1;
     }
 
     char RNASequence::operator[](const int index) const {
@@ -318,29 +370,21 @@ namespace pmfe {
         return result;
     }
 
-    RNASequenceWithTables::RNASequenceWithTables(const RNASequence& seq):
+    template <typename E>
+    BasicRNASequenceWithTables<E>::BasicRNASequenceWithTables(const RNASequence& seq):
         RNASequence(seq),
-        W(boost::extents[len()]),
-        V(boost::extents[len()][len()]),
-        VBI(boost::extents[len()][len()]),
-        VM(boost::extents[len()][len()]),
-        WM(boost::extents[len()][len()]),
-        WMPrime(boost::extents[len()][len()]),
-        FM(boost::extents[len()][len()]),
-        FM1(boost::extents[len()][len()])
-    {
-        // All the arrays should be filled with infinity
-        std::fill(W.data(), W.data() + W.num_elements(), Rational::infinity());
-        std::fill(V.data(), V.data() + V.num_elements(), Rational::infinity());
-        std::fill(VBI.data(), VBI.data() + VBI.num_elements(), Rational::infinity());
-        std::fill(VM.data(), VM.data() + VM.num_elements(), Rational::infinity());
-        std::fill(WM.data(), WM.data() + WM.num_elements(), Rational::infinity());
-        std::fill(WMPrime.data(), WMPrime.data() + WMPrime.num_elements(), Rational::infinity());
-        std::fill(FM.data(), FM.data() + FM.num_elements(), Rational::infinity());
-        std::fill(FM1.data(), FM1.data() + FM1.num_elements(), Rational::infinity());
-    }
-
-    void RNASequenceWithTables::print_debug(){
+        W(len(), E::infinity()),
+        V(len(), E::infinity()),
+        VBI(len(), E::infinity()),
+        VM(len(), E::infinity()),
+        WM(len(), E::infinity()),
+        WMPrime(len(), E::infinity()),
+        FM(len(), E::infinity()),
+        FM1(len(), E::infinity())
+    {};
+
+    template <typename E>
+    void BasicRNASequenceWithTables<E>::print_debug(){
         printf("Intermediate tables:\n");
         for (int b = 4; b <= len(); ++b) {
             for (int i = 1; i <= len() - b; ++i) {
@@ -428,6 +472,19 @@ namespace pmfe {
         return results;
     }
 
+    std::string RNAStructure::shape() const {
+        /*
+          Return the abstract shape of this structure, which keeps only the nesting of its helices.
+          A helix is a chain of pairs each enclosing just the next, so unpaired bases, bulges and
+          interior loops are forgotten, and an unstructured sequence has the shape _.
+        */
+        std::vector<ShapeItem> items;
+        for (auto& pair: pairs()) {
+            items.push_back(ShapeItem {pair.first, pair.second, ""});
+        }
+        return abstract_shape(items);
+    }
+
     std::ostream& operator<<(std::ostream& os, const RNAStructure& structure) {
         os << structure.structure_as_chars;
         return os;
@@ -479,47 +536,261 @@ namespace pmfe {
         }
     };
 
-    std::ostream& operator<<(std::ostream& os, const Segment& seg) {
+    template <typename E>
+    std::ostream& operator<<(std::ostream& os, const BasicSegment<E>& seg) {
         os << "(" << seg.i << ", " << seg.j << ")_" << seg.label;
         return os;
     }
 
-    RNAPartialStructure::RNAPartialStructure():
-        RNAStructure(),
-        known_energy(0)
+    template <typename E>
+    BasicRNAPartialStructure<E>::BasicRNAPartialStructure():
+        seq(nullptr),
+        arena(nullptr),
+        segments(nullptr),
+        marks(nullptr),
+        known_energy(0),
+        multiloops(0),
+        unpaired(0),
+        branches(0)
     {};
 
-    RNAPartialStructure::RNAPartialStructure(const RNASequence& seq, Rational known_energy):
-        RNAStructure(seq),
-        known_energy(known_energy)
+    template <typename E>
+    BasicRNAPartialStructure<E>::BasicRNAPartialStructure(const RNASequence& seq, Arena& arena, E known_energy):
+        seq(&seq),
+        arena(&arena),
+        segments(nullptr),
+        marks(nullptr),
+        known_energy(known_energy),
+        multiloops(0),
+        unpaired(0),
+        branches(0)
     {};
 
-    void RNAPartialStructure::accumulate(Rational energy) {
+    template <typename E>
+    BasicRNAPartialStructure<E>::BasicRNAPartialStructure(const BasicRNAPartialStructure& other):
+        seq(other.seq),
+        arena(other.arena),
+        segments(other.segments),
+        marks(other.marks),
+        known_energy(other.known_energy),
+        multiloops(other.multiloops),
+        unpaired(other.unpaired),
+        branches(other.branches)
+    {
+        // Share the lists of the other structure
+        if (segments != nullptr) {
+            ++segments->refs;
+        }
+        if (marks != nullptr) {
+            ++marks->refs;
+        }
+    };
+
+    template <typename E>
+    BasicRNAPartialStructure<E>::BasicRNAPartialStructure(BasicRNAPartialStructure&& other):
+        seq(other.seq),
+        arena(other.arena),
+        segments(other.segments),
+        marks(other.marks),
+        known_energy(other.known_energy),
+        multiloops(other.multiloops),
+        unpaired(other.unpaired),
+        branches(other.branches)
+    {
+        other.segments = nullptr;
+        other.marks = nullptr;
+    };
+
+    template <typename E>
+    BasicRNAPartialStructure<E>& BasicRNAPartialStructure<E>::operator=(BasicRNAPartialStructure other) {
+        std::swap(seq, other.seq);
+        std::swap(arena, other.arena);
+        std::swap(segments, other.segments);
+        std::swap(marks, other.marks);
+        std::swap(known_energy, other.known_energy);
+        std::swap(multiloops, other.multiloops);
+        std::swap(unpaired, other.unpaired);
+        std::swap(branches, other.branches);
+        return *this;
+    };
+
+    template <typename E>
+    BasicRNAPartialStructure<E>::~BasicRNAPartialStructure() {
+        if (arena != nullptr) {
+            arena->segment_nodes.release(segments);
+            arena->mark_nodes.release(marks);
+        }
+    };
+
+    template <typename E>
+    int BasicRNAPartialStructure<E>::len() const {
+        return seq->len();
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::mark(int i, int j, char symbol) {
+        typename Arena::MarkNode* node = arena->mark_nodes.allocate();
+        node->i = i;
+        node->j = j;
+        node->symbol = symbol;
+        node->next = marks; // Takes over our reference to the earlier marks
+        marks = node;
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::mark_pair(int i, int j) {
+        mark(i, j, p5symb);
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::mark_d5(int i) {
+        mark(i, -1, d5symb);
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::mark_d3(int i) {
+        mark(i, -1, d3symb);
+    };
+
+    template <typename E>
+    RNAStructure BasicRNAPartialStructure<E>::structure() const {
+        RNAStructure result(*seq);
+        for (const typename Arena::MarkNode* node = marks; node != nullptr; node = node->next) {
+            if (node->symbol == p5symb) {
+                result.mark_pair(node->i, node->j);
+            } else if (node->symbol == d5symb) {
+                result.mark_d5(node->i);
+            } else {
+                result.mark_d3(node->i);
+            }
+        }
+        return result;
+    };
+
+    template <typename E>
+    std::string BasicRNAPartialStructure<E>::shape() const {
+        /*
+          Each pending segment appears in the shape as itself, and a helix is only closed off
+          where no segment could still extend it
+        */
+        std::vector<ShapeItem> items;
+        for (const typename Arena::MarkNode* node = marks; node != nullptr; node = node->next) {
+            if (node->symbol == p5symb) {
+                items.push_back(ShapeItem {node->i, node->j, ""});
+            }
+        }
+
+        for (const typename Arena::SegmentNode* node = segments; node != nullptr; node = node->next) {
+            std::ostringstream token;
+            token << "{" << node->seg << "}";
+            items.push_back(ShapeItem {node->seg.i, node->seg.j, token.str()});
+        }
+
+        return abstract_shape(items);
+    };
+
+    template <typename E>
+    BasicRNAPartialStructure<E> BasicRNAPartialStructure<E>::adopted(Arena& arena) const {
+        /*
+          Copy both lists node by node, so the copy shares nothing with this structure
+        */
+        BasicRNAPartialStructure result(*seq, arena, known_energy);
+        result.multiloops = multiloops;
+        result.unpaired = unpaired;
+        result.branches = branches;
+
+        std::vector<const typename Arena::SegmentNode*> segment_path;
+        for (const typename Arena::SegmentNode* node = segments; node != nullptr; node = node->next) {
+            segment_path.push_back(node);
+        }
+        for (auto node = segment_path.rbegin(); node != segment_path.rend(); ++node) {
+            typename Arena::SegmentNode* copy = arena.segment_nodes.allocate();
+            copy->seg = (*node)->seg;
+            copy->next = result.segments;
+            result.segments = copy;
+        }
+
+        std::vector<const typename Arena::MarkNode*> mark_path;
+        for (const typename Arena::MarkNode* node = marks; node != nullptr; node = node->next) {
+            mark_path.push_back(node);
+        }
+        for (auto node = mark_path.rbegin(); node != mark_path.rend(); ++node) {
+            result.mark((*node)->i, (*node)->j, (*node)->symbol);
+        }
+
+        return result;
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::accumulate(E energy, int multiloops, int unpaired, int branches) {
         known_energy += energy;
+        this->multiloops += multiloops;
+        this->unpaired += unpaired;
+        this->branches += branches;
     };
 
-    Rational RNAPartialStructure::total() const {
+    template <typename E>
+    E BasicRNAPartialStructure<E>::total() const {
         return known_energy;
     };
 
-    void RNAPartialStructure::push(const Segment& seg) {
+    template <typename E>
+    int BasicRNAPartialStructure<E>::multiloop_count() const {
+        return multiloops;
+    };
+
+    template <typename E>
+    int BasicRNAPartialStructure<E>::unpaired_count() const {
+        return unpaired;
+    };
+
+    template <typename E>
+    int BasicRNAPartialStructure<E>::branch_count() const {
+        return branches;
+    };
+
+    template <typename E>
+    void BasicRNAPartialStructure<E>::push(const BasicSegment<E>& seg) {
         known_energy += seg.minimum_energy;
-        seg_stack.push(seg);
+
+        typename Arena::SegmentNode* node = arena->segment_nodes.allocate();
+        node->seg = seg;
+        node->next = segments; // Takes over our reference to the rest of the stack
+        segments = node;
     };
 
-    void RNAPartialStructure::pop() {
+    template <typename E>
+    void BasicRNAPartialStructure<E>::pop() {
+        assert(not empty());
         known_energy -= top().minimum_energy;
-        seg_stack.pop();
+
+        // Hold on to the rest of the stack before letting go of the top node
+        typename Arena::SegmentNode* node = segments;
+        segments = node->next;
+        if (segments != nullptr) {
+            ++segments->refs;
+        }
+        arena->segment_nodes.release(node);
     };
 
-    Segment RNAPartialStructure::top() const {
-        return seg_stack.top();
+    template <typename E>
+    BasicSegment<E> BasicRNAPartialStructure<E>::top() const {
+        assert(not empty());
+        return segments->seg;
     };
 
-    bool RNAPartialStructure::empty() const {
-        return seg_stack.empty();
+    template <typename E>
+    bool BasicRNAPartialStructure<E>::empty() const {
+        return segments == nullptr;
     };
 
+    template class BasicRNASequenceWithTables<Rational>;
+    template class BasicRNASequenceWithTables<FixedEnergy>;
+    template class BasicRNAPartialStructure<Rational>;
+    template class BasicRNAPartialStructure<FixedEnergy>;
+    template std::ostream& operator<<(std::ostream& os, const BasicSegment<Rational>& seg);
+    template std::ostream& operator<<(std::ostream& os, const BasicSegment<FixedEnergy>& seg);
+
     dangle_mode convert_to_dangle_mode(int n) {
         switch (n) {
         case 0:
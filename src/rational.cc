@@ -2,6 +2,8 @@
 
 #include <stdexcept>
 #include <iostream>
+#include <limits>
+#include <string>
 
 #include <gmpxx.h>
 #include <CGAL/Gmpq.h>
@@ -9,82 +11,162 @@
 #include "rational.h"
 
 namespace pmfe {
+    namespace {
+        unsigned long magnitude(long x) {
+            // Well-defined even for the most negative long
+            return (x < 0) ? 0UL - static_cast<unsigned long>(x) : static_cast<unsigned long>(x);
+        }
+
+        unsigned long gcd(unsigned long a, unsigned long b) {
+            while (b != 0) {
+                unsigned long t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+        /*
+          Multiply two canonical inline fractions a/b and c/d without GMP.
+          Cancelling across the product first keeps the result canonical.
+          Returns false if any intermediate value overflows.
+        */
+        bool multiply_inline(long a, long b, long c, long d, long& num, long& den) {
+            long g1 = gcd(magnitude(a), d);
+            long g2 = gcd(magnitude(c), b);
+            return (not __builtin_mul_overflow(a / g1, c / g2, &num) and
+                    not __builtin_mul_overflow(b / g2, d / g1, &den));
+        }
+    }
+
     Rational Rational::infinity() {
-        Rational result(0);
-        result.m_isFinite = false;
+        Rational result;
+        result.m_num = 1;
+        result.m_den = 0;
         return result;
     }
 
-    bool Rational::isFinite() const {
-        return m_isFinite;
-    };
-
     double Rational::get_d() const {
-        if (isFinite()) {
-            return m_value.get_d();
-        } else {
+        if (not isFinite()) {
             return std::numeric_limits<double>::infinity();
+        } else if (not m_big and m_den == 1) {
+            return m_num;
+        } else {
+            return get_mpq().get_d();
         }
     };
 
     void Rational::canonicalize() {
-        m_value.canonicalize();
+        // Values are always stored in canonical form
     }
 
     std::string Rational::get_str(int base) const {
-        if (isFinite()) {
-            return m_value.get_str(base);
-        } else {
+        if (not isFinite()) {
             return "∞";
+        } else if (not m_big and base == 10) {
+            std::string result = std::to_string(m_num);
+            if (m_den != 1) {
+                result += "/" + std::to_string(m_den);
+            }
+            return result;
+        } else {
+            return get_mpq().get_str(base);
         }
     }
 
-    Rational& Rational::operator+=(const Rational& rhs) {
-        if (isFinite() and rhs.isFinite()) {
-            m_value += rhs.m_value;
-            return *this;
-        } else if (not isFinite()) {
-            return *this;
+    void Rational::set(const mpq_class& value) {
+        if (mpz_fits_slong_p(value.get_num_mpz_t()) and mpz_fits_slong_p(value.get_den_mpz_t())) {
+            m_num = value.get_num().get_si();
+            m_den = value.get_den().get_si();
+            m_big.reset();
         } else {
-            m_value = rhs.m_value;
-            m_isFinite = rhs.m_isFinite;
-            return *this;
+            m_num = 0;
+            m_den = 1;
+            m_big = std::make_shared<const mpq_class>(value);
         }
-    };
+    }
 
-    Rational operator+(const Rational& lhs, const Rational& rhs) {
-        Rational result = lhs;
-        result += rhs;
-        return result;
+    mpq_class Rational::get_mpq() const {
+        if (m_big) {
+            return *m_big;
+        } else {
+            mpq_class result;
+            mpq_set_si(result.get_mpq_t(), m_num, static_cast<unsigned long>(m_den));
+            return result;
+        }
     }
 
-    Rational& Rational::operator-=(const Rational& rhs) {
-        if (isFinite() and rhs.isFinite()) {
-            m_value -= rhs.m_value;
+    void Rational::reduce() {
+        unsigned long g = gcd(magnitude(m_num), m_den);
+        if (g > 1) {
+            m_num /= static_cast<long>(g);
+            m_den /= static_cast<long>(g);
+        }
+    }
+
+    Rational& Rational::add_slow(const Rational& rhs, bool subtract) {
+        if (not isFinite()) {
+            if (subtract and not rhs.isFinite()) {
+                throw std::logic_error("Invalid arithmetic with ∞.");
+            }
             return *this;
-        } else if (not isFinite() and rhs.isFinite()) {
+        } else if (not rhs.isFinite()) {
+            if (subtract) {
+                throw std::logic_error("Invalid arithmetic with ∞.");
+            }
+            *this = rhs;
             return *this;
-        } else {
-            throw std::logic_error("Invalid arithmetic with ∞.");
         }
-    };
 
-    Rational operator-(const Rational& lhs, const Rational& rhs) {
-        Rational result = lhs;
-        result -= rhs;
-        return result;
+        if (not m_big and not rhs.m_big) {
+            // a/b ± c/d = (a*(d/g) ± c*(b/g)) / (b*(d/g)) with g = gcd(b, d)
+            long g = gcd(m_den, rhs.m_den);
+            long left, right, num, den;
+            if (not __builtin_mul_overflow(m_num, rhs.m_den / g, &left) and
+                not __builtin_mul_overflow(rhs.m_num, m_den / g, &right) and
+                not (subtract ? __builtin_sub_overflow(left, right, &num) : __builtin_add_overflow(left, right, &num)) and
+                not __builtin_mul_overflow(m_den, rhs.m_den / g, &den)) {
+                m_num = num;
+                m_den = den;
+                reduce();
+                return *this;
+            }
+        }
+
+        mpq_class result = get_mpq();
+        if (subtract) {
+            result -= rhs.get_mpq();
+        } else {
+            result += rhs.get_mpq();
+        }
+        set(result);
+        return *this;
     }
 
+    bool Rational::less_slow(const Rational& lhs, const Rational& rhs) {
+        if (not rhs.isFinite()) {
+            return lhs.isFinite();
+        } else if (not lhs.isFinite()) {
+            return false;
+        } else {
+            return lhs.get_mpq() < rhs.get_mpq();
+        }
+    }
 
     Rational& Rational::operator*=(const Rational& rhs) {
         if (isFinite() and rhs.isFinite()) {
-            m_value *= rhs.m_value;
+            long num, den;
+            if (not m_big and not rhs.m_big and multiply_inline(m_num, m_den, rhs.m_num, rhs.m_den, num, den)) {
+                m_num = num;
+                m_den = den;
+            } else {
+                set(get_mpq() * rhs.get_mpq());
+            }
             return *this;
         } else if (not isFinite() and rhs != 0) {
             return *this;
-        } else if (not rhs.isFinite() and this != 0) {
-            m_value = 0;
-            m_isFinite = rhs.m_isFinite;
+        } else if (not rhs.isFinite() and *this != 0) {
+            *this = rhs;
             return *this;
         } else {
             throw std::logic_error("Invalid arithmetic with ∞.");
@@ -99,12 +181,27 @@ namespace pmfe {
 
     Rational& Rational::operator/=(const Rational& rhs) {
         if (isFinite() and rhs.isFinite()) {
-            m_value /= rhs.m_value;
+            if (rhs == 0) {
+                throw std::logic_error("Division by zero.");
+            }
+
+            // Divide by multiplying with the reciprocal d/c, keeping its denominator positive
+            long num, den;
+            if (not m_big and not rhs.m_big and rhs.m_num != std::numeric_limits<long>::min() and
+                multiply_inline(m_num, m_den,
+                                (rhs.m_num < 0) ? -rhs.m_den : rhs.m_den,
+                                (rhs.m_num < 0) ? -rhs.m_num : rhs.m_num,
+                                num, den)) {
+                m_num = num;
+                m_den = den;
+            } else {
+                set(get_mpq() / rhs.get_mpq());
+            }
             return *this;
         } else if (not isFinite() and rhs != 0) {
             return *this;
-        } else if (isFinite() and this != 0 and not rhs.isFinite()) {
-            m_value = 0;
+        } else if (isFinite() and not rhs.isFinite()) {
+            *this = Rational(0);
             return *this;
         } else {
             throw std::logic_error("Invalid arithmetic with ∞.");
@@ -117,47 +214,13 @@ namespace pmfe {
         return result;
     };
 
-    bool operator==(const Rational& lhs, const Rational& rhs) {
-        if (lhs.isFinite() and rhs.isFinite() and lhs.m_value == rhs.m_value) {
-            return true;
-        } else if (not lhs.isFinite() and not rhs.isFinite()) {
-            return true;
-        } else {
-            return false;
-        }
-    };
-
-    bool operator!=(const Rational& lhs, const Rational& rhs) {
-        return not (lhs == rhs);
-    };
-
-    bool operator<(const Rational& lhs, const Rational& rhs) {
-        if (lhs.isFinite() and rhs.isFinite() and lhs.m_value < rhs.m_value) {
-            return true;
-        } else if (lhs.isFinite() and not rhs.isFinite()) {
-            return true;
-        } else {
-            return false;
-        }
-    };
-
-    bool operator<=(const Rational& lhs, const Rational& rhs) {
-        return (lhs < rhs or lhs == rhs);
-    }
-
-    bool operator>(const Rational& lhs, const Rational& rhs) {
-        return (rhs < lhs);
-    }
-
-    bool operator>=(const Rational& lhs, const Rational& rhs) {
-        return (rhs <= lhs);
-    }
-
     std::ostream& operator<<(std::ostream& os, const Rational& energy) {
-        if (energy.isFinite())  {
-            os << energy.m_value;
-        } else {
+        if (not energy.isFinite()) {
             os << "∞";
+        } else if (energy.m_big) {
+            os << *energy.m_big;
+        } else {
+            os << energy.get_mpq();
         }
 
         return os;
@@ -165,7 +228,7 @@ namespace pmfe {
 
     Rational::operator mpq_class() const {
         if (isFinite()) {
-            return m_value;
+            return get_mpq();
         } else {
             throw std::logic_error("Cannot convert ∞ to rational.");
         }
@@ -173,7 +236,7 @@ namespace pmfe {
 
     Rational::operator CGAL::Gmpq() const {
         if (isFinite()) {
-            return CGAL::Gmpq(m_value.get_mpq_t());
+            return CGAL::Gmpq(get_mpq().get_mpq_t());
         } else {
             throw std::logic_error("Cannot convert ∞ to rational.");
         }
@@ -44,6 +44,36 @@ namespace pmfe {
         return pv;
     }
 
+    namespace {
+        template <typename E>
+        RNAStructureWithScore oracle_structure(const BasicNNDBConstants<E>& constants, const RNASequence& sequence, dangle_mode dangles, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+
+            // Compute the energy tables
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(sequence);
+
+            return energy_model.mfe_structure(seq_annotated);
+        }
+
+        BBP::FPoint detached_copy(const BBP::FPoint& point) {
+            // CGAL may share coordinates between copies through reference counts which are not thread-safe,
+            // so a point kept past a concurrent oracle call must not share them with the caller's
+            std::vector<Q> coordinates;
+            for (int i = 0; i < point.dimension(); ++i) {
+                coordinates.push_back(Q(point.cartesian(i).mpq()));
+            }
+            return BBP::FPoint(point.dimension(), coordinates.begin(), coordinates.end());
+        }
+
+        bool precedes(const RNAStructureWithScore& left, const RNAStructureWithScore& right) {
+            // Canonical choice among structures found for the same point
+            if (left.string() != right.string()) {
+                return left.string() < right.string();
+            }
+            return left.score.energy < right.score.energy;
+        }
+    }
+
     BBP::FPoint scored_structure_to_fp(RNAStructureWithScore structure) {
         std::vector<Rational> values = {structure.score.multiloops, structure.score.unpaired, structure.score.branches, structure.score.w};
         BBP::FPoint result(4, values.begin(), values.end());
@@ -51,18 +81,20 @@ namespace pmfe {
     };
     
     //Constructor for full 4D calculation
-    RNAPolytope::RNAPolytope(RNASequence sequence, pmfe::dangle_mode dangles):
+    RNAPolytope::RNAPolytope(RNASequence sequence, pmfe::dangle_mode dangles, bool no_lonely_pairs):
         BBPolytope(4),
         sequence(sequence),
         dangles(dangles),
+        no_lonely_pairs(no_lonely_pairs),
         scale_b_param(false)
         {};
 
     //Constructor for b-slice
-    RNAPolytope::RNAPolytope(RNASequence sequence, pmfe::dangle_mode dangles, Rational m_weight):
+    RNAPolytope::RNAPolytope(RNASequence sequence, pmfe::dangle_mode dangles, bool no_lonely_pairs, Rational m_weight):
         BBPolytope(3),
         sequence(sequence),
         dangles(dangles),
+        no_lonely_pairs(no_lonely_pairs),
         multiloop_weight(m_weight),
         scale_b_param(true)
         {};
@@ -76,13 +108,16 @@ namespace pmfe {
             params = fv_to_pv(objective);
         }
         Turner99 constants(params);
-        NNTM energy_model(constants, dangles);
 
-        // Compute the energy tables
-        RNASequenceWithTables seq_annotated = energy_model.energy_tables(sequence);
-
-        // Find the MFE structure
-        RNAStructureWithScore scored_structure = energy_model.mfe_structure(seq_annotated);
+        // Find the MFE structure, using fixed-point energies whenever they are exact
+        RNAStructureWithScore scored_structure;
+        Integer scale = fixed_point_scale(constants, sequence.len());
+        if (scale != 0) {
+            FixedNNDBConstants fixed_constants(constants, scale);
+            scored_structure = oracle_structure(fixed_constants, sequence, dangles, no_lonely_pairs);
+        } else {
+            scored_structure = oracle_structure(constants, sequence, dangles, no_lonely_pairs);
+        }
         BBP::FPoint result = scored_structure_to_fp(scored_structure);
 
         if(scale_b_param){
@@ -90,7 +125,17 @@ namespace pmfe {
         }
 
         // TODO: Handle storing stuctures in class after conversion to dD_triangulation
-        structures.insert(std::make_pair(result, scored_structure));
+        // Several objectives may find the same point, so keep the structure which precedes the others,
+        // whatever order the oracle calls ran in
+#pragma omp critical(rna_polytope_state)
+        {
+            auto known = structures.find(result);
+            if (known == structures.end()) {
+                structures.insert(std::make_pair(detached_copy(result), scored_structure));
+            } else if (precedes(scored_structure, known->second)) {
+                known->second = scored_structure;
+            }
+        }
         return result;
     };
 
@@ -135,10 +180,10 @@ namespace pmfe {
     };
 
     void RNAPolytope::hook_perloop(size_t confirmed) {
-        BOOST_LOG_TRIVIAL(info) << "Facets (confirmed / known): " << confirmed << " / " << number_of_simplices() << ".";
+        BOOST_LOG_TRIVIAL(info) << "Facets (confirmed / known): " << confirmed << " / " << number_of_simplices() << ". Oracle calls: " << oracle_calls << ".";
     };
 
     void RNAPolytope::hook_postloop() {
-        BOOST_LOG_TRIVIAL(info) << "Polytope complete.";
+        BOOST_LOG_TRIVIAL(info) << "Polytope complete after " << oracle_calls << " oracle calls.";
     };
 };
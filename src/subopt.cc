@@ -1,5 +1,8 @@
 // Copyright (c) Andrew Gainer-Dewar 2015
 
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <boost/filesystem.hpp>
@@ -11,12 +14,132 @@
 namespace fs = boost::filesystem;
 
 namespace pmfe {
-    std::vector<RNAStructureWithScore> suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool sorted, bool transform) {
+    namespace {
+        template <typename E>
+        std::vector<RNAStructureWithScore> suboptimal_structures(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Rational& delta, bool sorted, bool transform, bool verify, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            return energy_model.suboptimal_structures(seq_annotated, delta, sorted, transform, verify);
+        }
+
+        template <typename E>
+        void visit_suboptimal_structures(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            energy_model.visit_suboptimal_structures(seq_annotated, delta, visit, transform, verify);
+        }
+
+        template <typename E>
+        void visit_best_suboptimal_structures(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Rational& delta, std::size_t count, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            energy_model.visit_best_suboptimal_structures(seq_annotated, delta, count, visit, transform, verify);
+        }
+
+        template <typename E>
+        void visit_shape_structures(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            energy_model.visit_shape_structures(seq_annotated, delta, visit, transform, verify);
+        }
+
+        template <typename E>
+        EnergyHistogram count_suboptimal_structures(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Rational& delta, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            return energy_model.count_suboptimal_structures(seq_annotated, delta);
+        }
+
+        template <typename E>
+        Rational suboptimal_delta_for_count(const BasicNNDBConstants<E>& constants, const RNASequence& seq, const dangle_mode& dangles, const Integer& count, bool no_lonely_pairs) {
+            BasicNNTM<E> energy_model(constants, dangles, no_lonely_pairs);
+            BasicRNASequenceWithTables<E> seq_annotated = energy_model.energy_tables(seq);
+            return energy_model.delta_for_count(seq_annotated, count);
+        }
+
+        // Call fixed or exact on the constants and args, using fixed point whenever it is exact for energies up to extra
+        // Without generic lambdas, both instantiations of the calculation are passed
+        template <typename R, typename... Params, typename... Args>
+        R with_energy_type(const NNDBConstants& constants, int length, const Rational& extra, R (*fixed)(const FixedNNDBConstants&, Params...), R (*exact)(const NNDBConstants&, Params...), Args&&... args) {
+            Integer scale = fixed_point_scale(constants, length, extra);
+            if (scale != 0) {
+                FixedNNDBConstants fixed_constants(constants, scale);
+                return fixed(fixed_constants, std::forward<Args>(args)...);
+            } else {
+                return exact(constants, std::forward<Args>(args)...);
+            }
+        }
+    }
+
+    std::vector<RNAStructureWithScore> suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool sorted, bool transform, bool verify, bool no_lonely_pairs) {
+        Turner99 constants(params);
+        RNASequence seq(seq_file);
+
+        return with_energy_type(constants, seq.len(), delta, &suboptimal_structures<FixedEnergy>, &suboptimal_structures<Rational>, seq, dangles, delta, sorted, transform, verify, no_lonely_pairs);
+    }
+
+    void visit_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
+        Turner99 constants(params);
+        RNASequence seq(seq_file);
+
+        with_energy_type(constants, seq.len(), delta, &visit_suboptimal_structures<FixedEnergy>, &visit_suboptimal_structures<Rational>, seq, dangles, delta, visit, transform, verify, no_lonely_pairs);
+    }
+
+    void visit_best_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, std::size_t count, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
+        Turner99 constants(params);
+        RNASequence seq(seq_file);
+
+        with_energy_type(constants, seq.len(), delta, &visit_best_suboptimal_structures<FixedEnergy>, &visit_best_suboptimal_structures<Rational>, seq, dangles, delta, count, visit, transform, verify, no_lonely_pairs);
+    }
+
+    void visit_shape_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, const StructureVisitor& visit, bool transform, bool verify, bool no_lonely_pairs) {
         Turner99 constants(params);
         RNASequence seq(seq_file);
-        NNTM energy_model(constants, dangles);
-        RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
-        std::vector<RNAStructureWithScore> results = energy_model.suboptimal_structures(seq_annotated, delta, sorted, transform);
-        return results;
+
+        with_energy_type(constants, seq.len(), delta, &visit_shape_structures<FixedEnergy>, &visit_shape_structures<Rational>, seq, dangles, delta, visit, transform, verify, no_lonely_pairs);
+    }
+
+    std::vector<ScoreSignature> suboptimal_signatures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool transform, bool verify, bool no_lonely_pairs) {
+        // Keep only a count and a representative for each score vector, rather than every structure
+        std::unordered_map<ScoreVector, ScoreSignature, ScoreVectorHash> signatures;
+        visit_suboptimal_structures(seq_file, params, dangles, delta, [&signatures](const RNAStructureWithScore& structure) {
+                auto found = signatures.find(structure.score);
+                if (found == signatures.end()) {
+                    signatures.emplace(structure.score, ScoreSignature {structure, 1});
+                } else {
+                    ScoreSignature& signature = found->second;
+                    ++signature.count;
+                    // Choose the representative independently of the enumeration order
+                    if (structure.string() < signature.representative.string()) {
+                        signature.representative = structure;
+                    }
+                }
+            }, transform, verify, no_lonely_pairs);
+
+        std::vector<ScoreSignature> result;
+        result.reserve(signatures.size());
+        for (auto& signature: signatures) {
+            result.push_back(std::move(signature.second));
+        }
+
+        std::sort(result.begin(), result.end(), [](const ScoreSignature& a, const ScoreSignature& b) {
+                return a.representative.score < b.representative.score;
+            });
+        return result;
+    }
+
+    EnergyHistogram count_suboptimal_structures(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Rational& delta, bool no_lonely_pairs) {
+        Turner99 constants(params);
+        RNASequence seq(seq_file);
+
+        return with_energy_type(constants, seq.len(), delta, &count_suboptimal_structures<FixedEnergy>, &count_suboptimal_structures<Rational>, seq, dangles, delta, no_lonely_pairs);
+    }
+
+    Rational suboptimal_delta_for_count(const fs::path seq_file, const ParameterVector& params, const dangle_mode& dangles, const Integer& count, bool no_lonely_pairs) {
+        Turner99 constants(params);
+        RNASequence seq(seq_file);
+
+        // The deltas tried are integers, so they need no finer scale
+        return with_energy_type(constants, seq.len(), Rational(0), &suboptimal_delta_for_count<FixedEnergy>, &suboptimal_delta_for_count<Rational>, seq, dangles, count, no_lonely_pairs);
     }
 }
@@ -1,6 +1,8 @@
 // Copyright (c) 2015 Andrew Gainer-Dewar
 
 #include "catch.hpp"
+#include <algorithm>
+#include <set>
 #include <boost/filesystem.hpp>
 
 #include "mfe.h"
@@ -34,6 +36,26 @@ TEST_CASE("A. tabira 5S MFE", "[mfe][biological][atabira][5S]") {
         REQUIRE(scored_structure.old_string() ==
                 "(((((((((.....((((((((((...((.((((......))))..))..)))...)))))))..(((((((...(.((..(..((....))..)..)))..))))))))))))))))..");
     }
+
+    SECTION("Turner99 published parameters in fixed point") {
+        pmfe::Turner99 constants;
+        pmfe::Integer scale = pmfe::fixed_point_scale(constants, seq.len());
+        REQUIRE(scale != 0);
+
+        pmfe::FixedNNDBConstants fixed_constants(constants, scale);
+        pmfe::FixedNNTM energy_model(fixed_constants, pmfe::CHOOSE_DANGLE);
+
+        pmfe::BasicRNASequenceWithTables<pmfe::FixedEnergy> seq_annotated = energy_model.energy_tables(seq);
+
+        pmfe::Rational energy = energy_model.to_rational(energy_model.minimum_energy(seq_annotated));
+
+        REQUIRE(energy == pmfe::Rational(-533, 10));
+
+        pmfe::RNAStructureWithScore scored_structure = energy_model.mfe_structure(seq_annotated);
+
+        REQUIRE(scored_structure.old_string() ==
+                "(((((((((.....((((((((((...((.((((......))))..))..)))...)))))))..(((((((...(.((..(..((....))..)..)))..))))))))))))))))..");
+    }
 }
 
 TEST_CASE("C. diphtheriae tRNA MFE", "[mfe][biological][cdiphtheriae][tRNA]") {
@@ -184,6 +206,23 @@ TEST_CASE("L. delbrueckii tRNA MFE", "[mfe][biological][ldelbrueckii][tRNA]") {
         REQUIRE(scored_structure.old_string() ==
                 "(((((((...............(((.(((((.......))))).)))..(((.......)))..))))))).");
     }
+
+    SECTION("Turner99 published parameters without lonely pairs") {
+        pmfe::Turner99 constants;
+        pmfe::NNTM energy_model(constants, pmfe::CHOOSE_DANGLE, true);
+
+        pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+        pmfe::Rational energy = energy_model.minimum_energy(seq_annotated);
+
+        REQUIRE(energy == pmfe::Rational(-239, 10));
+
+        // The closing pair of the multiloop is stacked, so its traceback starts from VP
+        pmfe::RNAStructureWithScore scored_structure = energy_model.mfe_structure(seq_annotated);
+
+        REQUIRE(scored_structure.old_string() ==
+                "(((((((...............(((.(((((.......))))).)))..(((.......)))..))))))).");
+    }
 }
 
 TEST_CASE("O. nivara tRNA MFE", "[mfe][biological][onivara][tRNA]") {
@@ -1189,3 +1228,145 @@ TEST_CASE("O. nivara tRNA (old) MFE", "[mfe][biological][onivara-old][trna]") {
                 "((((((((......((....)).....................(....)..............)))))))).");
     }
 }
+
+TEST_CASE("C. diphtheriae tRNA subopt counts", "[subopt][biological][cdiphtheriae][tRNA]") {
+    // Load the sequence
+    fs::path seqfile = fs::path(PMFE_PATH) / "test_seq/tRNA/c.diphtheriae_tRNA.fasta";
+    pmfe::RNASequence seq(seqfile);
+    pmfe::Turner99 constants;
+    pmfe::Rational delta(3);
+
+    for (pmfe::dangle_mode dangles: {pmfe::NO_DANGLE, pmfe::CHOOSE_DANGLE, pmfe::BOTH_DANGLE}) {
+        pmfe::NNTM energy_model(constants, dangles);
+        pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+        // The counts must agree with the structures actually enumerated
+        pmfe::EnergyHistogram enumerated;
+        for (auto& structure: energy_model.suboptimal_structures(seq_annotated, delta)) {
+            enumerated[structure.score.energy] += 1;
+        }
+
+        REQUIRE((energy_model.count_suboptimal_structures(seq_annotated, delta) == enumerated));
+    }
+}
+
+TEST_CASE("C. diphtheriae tRNA best structures without delta", "[subopt][biological][cdiphtheriae][tRNA]") {
+    // Load the sequence
+    fs::path seqfile = fs::path(PMFE_PATH) / "test_seq/tRNA/c.diphtheriae_tRNA.fasta";
+    pmfe::RNASequence seq(seqfile);
+    pmfe::Turner99 constants;
+    std::size_t count = 100;
+
+    for (pmfe::dangle_mode dangles: {pmfe::NO_DANGLE, pmfe::CHOOSE_DANGLE, pmfe::BOTH_DANGLE}) {
+        pmfe::NNTM energy_model(constants, dangles);
+        pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+        // An unbounded search must still stop after count structures, in increasing energy order
+        std::vector<pmfe::Rational> found;
+        energy_model.visit_best_suboptimal_structures(seq_annotated, pmfe::Rational::infinity(), count, [&found](const pmfe::RNAStructureWithScore& structure) {
+                found.push_back(structure.score.energy);
+            });
+
+        REQUIRE(found.size() == count);
+        REQUIRE(std::is_sorted(found.begin(), found.end()));
+
+        // Those must be the least energies of all structures
+        pmfe::Rational delta = found.back() - energy_model.minimum_energy(seq_annotated);
+        std::vector<pmfe::Rational> expected;
+        for (auto& structure: energy_model.suboptimal_structures(seq_annotated, delta, true)) {
+            expected.push_back(structure.score.energy);
+        }
+        expected.resize(count);
+
+        REQUIRE(found == expected);
+    }
+}
+
+TEST_CASE("H. sapiens tRNA delta for structure count", "[subopt][biological][hsapiens][tRNA]") {
+    // Load the sequence
+    fs::path seqfile = fs::path(PMFE_PATH) / "test_seq/tRNA/h.sapiens_tRNA.fasta";
+    pmfe::RNASequence seq(seqfile);
+    pmfe::Turner99 constants;
+    pmfe::NNTM energy_model(constants, pmfe::CHOOSE_DANGLE);
+    pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+    // Two structures share the minimum energy, so no delta allows only one
+    REQUIRE_THROWS_AS(energy_model.delta_for_count(seq_annotated, 1), const std::invalid_argument&);
+
+    for (long count: {2, 100, 5000}) {
+        pmfe::Rational delta = energy_model.delta_for_count(seq_annotated, count);
+        pmfe::EnergyHistogram histogram = energy_model.count_suboptimal_structures(seq_annotated, delta + pmfe::Rational(1, 10));
+
+        // The chosen delta must be the last level before the total passes count
+        pmfe::Integer total = 0;
+        for (auto& level: histogram) {
+            total += level.second;
+            if (level.first - histogram.begin()->first == delta) {
+                REQUIRE(total <= count);
+            } else if (level.first - histogram.begin()->first > delta) {
+                REQUIRE(total > count);
+            }
+        }
+    }
+}
+
+TEST_CASE("C. diphtheriae tRNA subopt without lonely pairs", "[subopt][biological][cdiphtheriae][tRNA]") {
+    // Load the sequence
+    fs::path seqfile = fs::path(PMFE_PATH) / "test_seq/tRNA/c.diphtheriae_tRNA.fasta";
+    pmfe::RNASequence seq(seqfile);
+    pmfe::Turner99 constants;
+    pmfe::Rational delta(3);
+
+    for (pmfe::dangle_mode dangles: {pmfe::NO_DANGLE, pmfe::CHOOSE_DANGLE, pmfe::BOTH_DANGLE}) {
+        pmfe::NNTM energy_model(constants, dangles, true);
+        pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+        pmfe::EnergyHistogram enumerated;
+        for (auto& structure: energy_model.suboptimal_structures(seq_annotated, delta, false, false, true)) {
+            // Every pair must stack on a neighbouring pair
+            std::set< std::pair<int, int> > pairs;
+            for (auto& pair: structure.pairs()) {
+                pairs.insert(pair);
+            }
+            for (auto& pair: pairs) {
+                REQUIRE((pairs.count(std::make_pair(pair.first+1, pair.second-1)) or pairs.count(std::make_pair(pair.first-1, pair.second+1))));
+            }
+            enumerated[structure.score.energy] += 1;
+        }
+
+        REQUIRE((energy_model.count_suboptimal_structures(seq_annotated, delta) == enumerated));
+        REQUIRE(energy_model.minimum_energy(seq_annotated) == energy_model.mfe_structure(seq_annotated).score.energy);
+    }
+}
+
+TEST_CASE("C. diphtheriae tRNA subopt shapes", "[subopt][biological][cdiphtheriae][tRNA]") {
+    // Load the sequence
+    fs::path seqfile = fs::path(PMFE_PATH) / "test_seq/tRNA/c.diphtheriae_tRNA.fasta";
+    pmfe::RNASequence seq(seqfile);
+    pmfe::Turner99 constants;
+    pmfe::Rational delta(6);
+
+    for (pmfe::dangle_mode dangles: {pmfe::NO_DANGLE, pmfe::CHOOSE_DANGLE, pmfe::BOTH_DANGLE}) {
+        pmfe::NNTM energy_model(constants, dangles);
+        pmfe::RNASequenceWithTables seq_annotated = energy_model.energy_tables(seq);
+
+        // Each shape must be reported once, with the least energy of any structure having it
+        std::map<std::string, pmfe::Rational> best;
+        for (auto& structure: energy_model.suboptimal_structures(seq_annotated, delta)) {
+            std::string shape = structure.shape();
+            if (best.count(shape) == 0 or structure.score.energy < best[shape]) {
+                best[shape] = structure.score.energy;
+            }
+        }
+
+        std::map<std::string, pmfe::Rational> found;
+        energy_model.visit_shape_structures(seq_annotated, delta, [&found](const pmfe::RNAStructureWithScore& structure) {
+                REQUIRE(found.count(structure.shape()) == 0);
+                found[structure.shape()] = structure.score.energy;
+            });
+
+        REQUIRE(found == best);
+    }
+
+    REQUIRE(pmfe::RNAStructure(seq, std::string(seq.len(), '.')).shape() == "_");
+}
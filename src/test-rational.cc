@@ -0,0 +1,105 @@
+// Copyright (c) 2015 Andrew Gainer-Dewar
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <gmpxx.h>
+
+#include "rational.h"
+
+TEST_CASE("Rational arithmetic", "[rational]") {
+    pmfe::Rational inf = pmfe::Rational::infinity();
+
+    SECTION("Inline values stay canonical") {
+        REQUIRE((pmfe::Rational(3, 10) + pmfe::Rational(7, 10)) == pmfe::Rational(1));
+        REQUIRE((pmfe::Rational(1, 6) + pmfe::Rational(1, 10)) == pmfe::Rational(4, 15));
+        REQUIRE((pmfe::Rational(2, 3) * pmfe::Rational(9, 4)) == pmfe::Rational(3, 2));
+        REQUIRE((pmfe::Rational(2, 3) / pmfe::Rational(-4, 9)) == pmfe::Rational(-3, 2));
+        REQUIRE((pmfe::Rational(12, 8)).get_str() == "3/2");
+        REQUIRE((pmfe::Rational(-5, 10) - pmfe::Rational(1, 2)).get_str() == "-1");
+    }
+
+    SECTION("Overflow promotes to GMP and small results demote again") {
+        pmfe::Rational big = pmfe::Rational(pmfe::Integer(std::numeric_limits<long>::max()));
+        big += 1;
+        REQUIRE(mpq_class(big) == mpq_class(pmfe::Integer(std::numeric_limits<long>::max())) + 1);
+        REQUIRE(big > pmfe::Rational(pmfe::Integer(std::numeric_limits<long>::max())));
+
+        pmfe::Rational back = big - 2;
+        REQUIRE(back == pmfe::Rational(pmfe::Integer(std::numeric_limits<long>::max() - 1)));
+        REQUIRE((big * 0) == pmfe::Rational(0));
+        REQUIRE(big < inf);
+    }
+
+    SECTION("Infinity behaves as before") {
+        REQUIRE(not inf.isFinite());
+        REQUIRE(inf == pmfe::Rational::infinity());
+        REQUIRE(pmfe::Rational(-1000) < inf);
+        REQUIRE(not (inf < inf));
+        REQUIRE(inf <= inf);
+        REQUIRE((inf + pmfe::Rational(5)) == inf);
+        REQUIRE((pmfe::Rational(5) + inf) == inf);
+        REQUIRE((inf - pmfe::Rational(5)) == inf);
+        REQUIRE((pmfe::Rational(3) * inf) == inf);
+        REQUIRE((pmfe::Rational(3) / inf) == pmfe::Rational(0));
+        REQUIRE_THROWS_AS(pmfe::Rational(5) - inf, std::logic_error&);
+        REQUIRE_THROWS_AS(inf * pmfe::Rational(0), std::logic_error&);
+        REQUIRE_THROWS_AS(pmfe::Rational(0) * inf, std::logic_error&);
+        REQUIRE(inf.get_str() == "∞");
+    }
+}
+
+TEST_CASE("Rational microbenchmark", "[.][rational][benchmark]") {
+    /*
+      Compare the inline representation with the plain mpq_class values Rational used to wrap,
+      on the sum-and-minimize pattern of the energy recursions.
+    */
+    const int count = 1000;
+    const int rounds = 200;
+
+    std::vector<pmfe::Rational> rationals;
+    std::vector<mpq_class> mpqs;
+    for (int i = 0; i < count; ++i) {
+        mpq_class value((i * 37) % 401 - 200, 10);
+        value.canonicalize();
+        rationals.push_back(pmfe::Rational(value));
+        mpqs.push_back(value);
+    }
+
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start = clock::now();
+    pmfe::Rational rational_min = pmfe::Rational::infinity();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 1; i < count; ++i) {
+            pmfe::Rational candidate = rationals[i - 1] + rationals[i];
+            if (candidate < rational_min) {
+                rational_min = candidate;
+            }
+        }
+    }
+    double rational_time = std::chrono::duration<double>(clock::now() - start).count();
+
+    start = clock::now();
+    mpq_class mpq_min = mpqs[0] + mpqs[1];
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 1; i < count; ++i) {
+            mpq_class candidate = mpqs[i - 1] + mpqs[i];
+            if (candidate < mpq_min) {
+                mpq_min = candidate;
+            }
+        }
+    }
+    double mpq_time = std::chrono::duration<double>(clock::now() - start).count();
+
+    REQUIRE(mpq_class(rational_min) == mpq_min);
+
+    std::cout << "operator+ / operator< over " << rounds * (count - 1) << " pairs: "
+              << "Rational " << rational_time << " s, mpq_class " << mpq_time << " s"
+              << std::endl;
+}